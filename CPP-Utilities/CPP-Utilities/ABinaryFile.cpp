@@ -8,122 +8,135 @@
 
 #include "ABinaryFile.hpp"
 #include "Debug.hpp"
+#include "BlockCache.hpp"
+#include "AsyncBlockLoader.hpp"
 #include <errno.h>
 #include <sys/stat.h>
 #include <algorithm>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <unordered_map>
+#include <condition_variable>
+
+// Smallest chunk LoadMode::parallel will use when choosing the size itself.
+#define MinParallelChunk (1 << 20)
+
+static double SecondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+};
 
 ABinaryFile::ABinaryFile() {
 	blob = nullptr;
 	size = 0;
+	loadStats = {LoadMode::read, 0, 0, 0, 0};
 };
 
-ABinaryFile::ABinaryFile(void* memoryBlock, uint64_t memSize) {
+ABinaryFile::ABinaryFile(void* memoryBlock, uint64_t memSize) : ABinaryFile() {
 	DebugPretty
 	
-	blob = malloc(memSize);
-	memcpy(blob, memoryBlock, memSize);
-	size = memSize;
+	void* data = malloc(memSize);
+	memcpy(data, memoryBlock, memSize);
+	Adopt(data, memSize, BlobKind::heap);
 };
 
-ABinaryFile::ABinaryFile(int desc) {
+ABinaryFile::ABinaryFile(ByteSpan view) : ABinaryFile() {
 	DebugPretty
 	
-	struct stat s;
-	bzero(&s, sizeof(s));
-	
-	int res = fstat(desc, &s);
-	if (res == -1) {
-		throw ABinaryFileEx(std::string("Open error ") + std::to_string(errno));
-	}
-	if ((s.st_mode & S_IFMT) != S_IFREG) {
-		throw ABinaryFileEx(std::string("Not a file"));
-	}
-	
-	FILE* F = fdopen(desc, "r");
-	if (!F) {
-		throw ABinaryFileEx(std::string("Open error ") + std::to_string(errno));
-	}
-	
-	blob = malloc(s.st_size);
-	size_t itemsRead = 0;
-	if (blob) {
-		size = s.st_size;
-		itemsRead = fread(blob, size, 1, F);
-	}
-	
-	fclose(F);
-	if (itemsRead == 0) {
-		throw ABinaryFileEx(std::string("Read error ") + std::to_string(errno));
+	// Never written to. The cast only satisfies the blob type.
+	if (view.data) {
+		Adopt(const_cast<uint8_t*>(view.data), view.size, BlobKind::borrowed);
 	}
+};
 
-#ifdef DebugBinaryDetailed
-	printf("\t%llu bytes loaded\n", size);
-#endif
+ABinaryFile::ABinaryFile(int desc) : ABinaryFile(desc, LoadMode::read) {
+};
+
+ABinaryFile::ABinaryFile(const std::string& path) : ABinaryFile(path, LoadMode::read) {
 };
 
-ABinaryFile::ABinaryFile(const std::string& path) {
+ABinaryFile::ABinaryFile(int desc, unsigned threads, uint64_t chunkSize) : ABinaryFile() {
 	DebugPretty
 	
-	struct stat s;
-	bzero(&s, sizeof(s));
+	ParallelLoad(desc, FileLength(desc), threads, chunkSize);
+};
+
+ABinaryFile::ABinaryFile(const std::string& path, unsigned threads, uint64_t chunkSize) : ABinaryFile() {
+	DebugPretty
 	
-	int res = stat(path.c_str(), &s);
-	if (res == -1) {
+	int desc = open(path.c_str(), O_RDONLY);
+	if (desc == -1) {
 		throw ABinaryFileEx(std::string("Open error ") + std::to_string(errno));
 	}
-	if ((s.st_mode & S_IFMT) != S_IFREG) {
-		throw ABinaryFileEx(std::string("Not a file"));
+	try {
+		ParallelLoad(desc, FileLength(desc), threads, chunkSize);
 	}
+	catch (...) {
+		close(desc);
+		throw;
+	}
+	close(desc);
+};
+
+ABinaryFile::ABinaryFile(int desc, LoadMode mode, AccessHint hint) : ABinaryFile() {
+	DebugPretty
+	
+	Load(desc, FileLength(desc), mode, hint);
+};
+
+ABinaryFile::ABinaryFile(const std::string& path, LoadMode mode, AccessHint hint) : ABinaryFile() {
+	DebugPretty
 	
-	FILE* F = fopen(path.c_str(), "r");
-	if (!F) {
+	// Non blocking so a FIFO is not waited on before FileLength() rejects it.
+	int desc = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+	if (desc == -1) {
 		throw ABinaryFileEx(std::string("Open error ") + std::to_string(errno));
 	}
-	
-	blob = malloc(s.st_size);
-	size_t itemsRead = 0;
-	if (blob) {
-		size = s.st_size;
-		 itemsRead = fread(blob, size, 1, F);
+	try {
+		// A mapping keeps its own reference to the file.
+		Load(desc, FileLength(desc), mode, hint);
 	}
-	
-	fclose(F);
-	if (itemsRead == 0) {
-		throw ABinaryFileEx(std::string("Read error ") + std::to_string(errno));
+	catch (...) {
+		close(desc);
+		throw;
 	}
-	
-#ifdef DebugBinaryDetailed
-	printf("\t%llu bytes loaded\n", size);
-#endif
+	close(desc);
 };
 
-
-ABinaryFile::ABinaryFile(const ABinaryFile& obj) {
+// Shares obj's data. A borrowed source is therefore borrowed again.
+ABinaryFile::ABinaryFile(const ABinaryFile& obj) : store(obj.store) {
 	DebugPretty
 	
+	blob = obj.blob;
 	size = obj.size;
-	if (size) {
-		blob = malloc(size);
-		memcpy(blob, obj.blob, size);
-	}
-	else { blob = nullptr; }
+	loadStats = obj.loadStats;
 };
 
 void Swap(ABinaryFile& A, ABinaryFile& B) {
+	std::swap(A.store, B.store);
 	std::swap(A.blob, B.blob);
 	std::swap(A.size, B.size);
+	std::swap(A.loadStats, B.loadStats);
 	
 #ifdef DebugBinaryDetailed
 	printf("Swapping %p & %p\n", &A, &B);
 #endif
 };
 
-ABinaryFile ABinaryFile::operator=(ABinaryFile obj) {
+ABinaryFile& ABinaryFile::operator=(const ABinaryFile& obj) {
 	DebugPretty
 	
 	if (this == &obj) { return *this; }
-	Swap(*this, obj);
+	store = obj.store;
+	blob = obj.blob;
+	size = obj.size;
+	loadStats = obj.loadStats;
 	return *this;
 };
 
@@ -134,24 +147,205 @@ ABinaryFile::ABinaryFile(ABinaryFile&& ref) : ABinaryFile() {
 	Swap(*this, ref);
 };
 
-ABinaryFile ABinaryFile::operator=(ABinaryFile&& ref) {
+ABinaryFile& ABinaryFile::operator=(ABinaryFile&& ref) {
 	DebugPretty
 	
 	assert(this != &ref);
-	if (blob) { free(blob); }
-	
-	blob = ref.blob;
-	size = ref.size;
-	ref.blob = nullptr;
-	ref.size = 0;
+	ReleaseBlob();
+	Swap(*this, ref);
 	
 	return *this;
 }
 
 ABinaryFile::~ABinaryFile() {
 	DebugPretty
+};
+
+//------------------
+
+ABinaryFile::BlobStore::~BlobStore() {
+	switch (kind) {
+		case BlobKind::heap:
+			free(data);
+			break;
+		case BlobKind::mapped:
+			munmap(data, size);
+			break;
+		case BlobKind::borrowed:
+		case BlobKind::none:
+			break;
+	}
+};
+
+void ABinaryFile::Adopt(void* data, uint64_t length, BlobKind kind) {
+	store = std::make_shared<BlobStore>(data, length, kind);
+	blob = data;
+	size = length;
+};
+
+//------------------
+
+bool ABinaryFile::MapFile(int desc, uint64_t length, AccessHint hint) {
+	DebugPretty
+	
+	// mmap() rejects a zero length. An empty file has nothing to map.
+	if (length == 0) { return true; }
+	
+	void* ptr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, desc, 0);
+	if (ptr == MAP_FAILED) { return false; }
+	
+	Adopt(ptr, length, BlobKind::mapped);
+	Advise(hint);
+	
+	return true;
+};
+
+void ABinaryFile::ReleaseBlob() {
+	store.reset();
+	blob = nullptr;
+	size = 0;
+	loadStats = {LoadMode::read, 0, 0, 0, 0};
+};
+
+//----
+
+uint64_t ABinaryFile::FileLength(int desc) {
+	struct stat s;
+	bzero(&s, sizeof(s));
+	
+	if (fstat(desc, &s) == -1) {
+		throw ABinaryFileEx(std::string("Open error ") + std::to_string(errno));
+	}
+	if ((s.st_mode & S_IFMT) != S_IFREG) {
+		throw ABinaryFileEx(std::string("Not a file"));
+	}
+	return s.st_size;
+};
+
+//----
+
+void ABinaryFile::Load(int desc, uint64_t length, LoadMode mode, AccessHint hint) {
+	DebugPretty
+	
+	if (mode == LoadMode::parallel) {
+		ParallelLoad(desc, length, 0, 0);
+		return;
+	}
+	
+	auto start = std::chrono::steady_clock::now();
+	if (mode == LoadMode::mapped) {
+		if (!MapFile(desc, length, hint)) {
+			throw ABinaryFileEx(std::string("Map error ") + std::to_string(errno));
+		}
+		loadStats = {LoadMode::mapped, size, 0, 0, SecondsSince(start)};
+#ifdef DebugBinaryDetailed
+		printf("\t%llu bytes mapped\n", size);
+#endif
+		return;
+	}
+	
+	ReadLoad(desc, length);
+	loadStats = {LoadMode::read, size, 1, 1, SecondsSince(start)};
+	
+#ifdef DebugBinaryDetailed
+	printf("\t%llu bytes loaded\n", size);
+#endif
+};
+
+void ABinaryFile::ReadLoad(int desc, uint64_t length) {
+	// An empty file has nothing to read.
+	if (length == 0) { return; }
+	
+	uint8_t* data = (uint8_t*)malloc(length);
+	if (!data) {
+		throw ABinaryFileEx(std::string("Read error ") + std::to_string(ENOMEM));
+	}
+	uint64_t done = 0;
+	while (done < length) {
+		ssize_t ct = pread(desc, data + done, length - done, done);
+		if (ct < 0 && errno == EINTR) { continue; }
+		if (ct <= 0) {
+			// The file shrank since it was measured.
+			int err = ct == 0 ? EIO : errno;
+			free(data);
+			throw ABinaryFileEx(std::string("Read error ") + std::to_string(err));
+		}
+		done += ct;
+	}
+	Adopt(data, length, BlobKind::heap);
+};
+
+void ABinaryFile::ParallelLoad(int desc, uint64_t length, unsigned threads, uint64_t chunkSize) {
+	DebugPretty
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	if (threads == 0) { threads = std::thread::hardware_concurrency(); }
+	if (threads == 0) { threads = 1; }
+	if (chunkSize == 0) {
+		// A few chunks per thread so a slow chunk does not hold up the rest.
+		chunkSize = length / ((uint64_t)threads * 4);
+		if (chunkSize < MinParallelChunk) { chunkSize = MinParallelChunk; }
+	}
+	uint64_t chunks = length > 0 ? (length - 1) / chunkSize + 1 : 0;
+	if (threads > chunks) { threads = chunks > 0 ? (unsigned)chunks : 1; }
+	
+	if (length > 0) {
+		void* data = malloc(length);
+		if (!data) { throw ABinaryFileEx("Blob memory failure"); }
+		Adopt(data, length, BlobKind::heap);
+	}
 	
-	if (blob) { free(blob); }
+	// Threads take the next chunk until there are none left or one fails.
+	std::atomic<uint64_t> nextChunk(0);
+	std::atomic<int> failure(0);
+	uint8_t* dest = (uint8_t*)blob;
+	
+	auto worker = [&]() {
+		for (;;) {
+			uint64_t chunk = nextChunk++;
+			if (chunk >= chunks || failure.load()) { return; }
+			
+			uint64_t pos = chunk * chunkSize;
+			uint64_t remaining = std::min(chunkSize, length - pos);
+			while (remaining > 0) {
+				ssize_t ct = pread(desc, dest + pos, remaining, pos);
+				if (ct < 0 && errno == EINTR) { continue; }
+				if (ct <= 0) {
+					// Zero means the file shrank under us.
+					failure = ct < 0 ? errno : EIO;
+					return;
+				}
+				pos += ct;
+				remaining -= ct;
+			}
+		}
+	};
+	
+	// This thread works too.
+	std::vector<std::thread> pool;
+	for (unsigned t = 1; t < threads; t++) {
+		try {
+			pool.emplace_back(worker);
+		}
+		catch (...) {
+			// Could not start another thread. Carry on with what we have.
+			break;
+		}
+	}
+	worker();
+	for (auto& th : pool) { th.join(); }
+	
+	if (failure) {
+		ReleaseBlob();
+		throw ABinaryFileEx(std::string("Read error ") + std::to_string(failure));
+	}
+	
+	loadStats = {LoadMode::parallel, length, (unsigned)pool.size() + 1, chunks, SecondsSince(start)};
+	
+#ifdef DebugBinaryDetailed
+	printf("\t%llu bytes loaded by %u threads in %llu chunks\n", size, loadStats.threads, chunks);
+#endif
 };
 
 //------------------
@@ -175,13 +369,15 @@ uint8_t ABinaryFile::operator[](uint64_t pos) const {
 /// If position+2 exceeds size, an exception will be thrown
 uint16_t ABinaryFile::B16(uint64_t bytePos) const {
 	if (bytePos+1 >= size) { throw ABinaryFileEx("Out of range"); }
-	uint16_t* ptr = (uint16_t*)&((uint8_t*)blob)[bytePos];
+	// memcpy() rather than a cast. bytePos is not necessarily aligned.
+	uint16_t v;
+	memcpy(&v, &((uint8_t*)blob)[bytePos], sizeof(v));
 
 #if DebugBinaryDetailed == 2
-	printf("Retrieving UInt16 %u at index %llu\n", *ptr, bytePos);
+	printf("Retrieving UInt16 %u at index %llu\n", v, bytePos);
 #endif
 
-	return *ptr;
+	return v;
 };
 
 
@@ -189,13 +385,15 @@ uint16_t ABinaryFile::B16(uint64_t bytePos) const {
 /// If position+4 exceeds size, an exception will be thrown
 uint32_t ABinaryFile::B32(uint64_t bytePos) const {
 	if (bytePos+3 >= size) { throw ABinaryFileEx("Out of range"); }
-	uint32_t* ptr = (uint32_t*)&((uint8_t*)blob)[bytePos];
+	// memcpy() rather than a cast. bytePos is not necessarily aligned.
+	uint32_t v;
+	memcpy(&v, &((uint8_t*)blob)[bytePos], sizeof(v));
 
 #if DebugBinaryDetailed == 2
-	printf("Retrieving UInt32 %lu at index %llu\n", *ptr, bytePos);
+	printf("Retrieving UInt32 %u at index %llu\n", v, bytePos);
 #endif
 
-	return *ptr;
+	return v;
 };
 
 
@@ -203,19 +401,136 @@ uint32_t ABinaryFile::B32(uint64_t bytePos) const {
 /// If position+8 exceeds size, an exception will be thrown
 uint64_t ABinaryFile::B64(uint64_t bytePos) const {
 	if (bytePos+7 >= size) { throw ABinaryFileEx("Out of range"); }
-	uint64_t* ptr = (uint64_t*)&((uint8_t*)blob)[bytePos];
+	// memcpy() rather than a cast. bytePos is not necessarily aligned.
+	uint64_t v;
+	memcpy(&v, &((uint8_t*)blob)[bytePos], sizeof(v));
+
+#if DebugBinaryDetailed == 2
+	printf("Retrieving UInt64 %llu at index %llu\n", v, bytePos);
+#endif
+
+	return v;
+};
+
+//----
 
+void ABinaryFile::DecodeValues(uint64_t bytePos, uint64_t count, void* dest, unsigned width, ByteOrder::Endian order) const {
 #if DebugBinaryDetailed == 2
-	printf("Retrieving UInt64 %llu at index %llu\n", *ptr, bytePos);
+	printf("Decoding %llu values of %u bytes at index %llu\n", count, width, bytePos);
 #endif
+	
+	if (count == 0) { return; }
+	// Written so that a huge count cannot overflow.
+	if (bytePos >= size || count > (size - bytePos) / width) { throw ABinaryFileEx("Out of range"); }
+	if (!dest) { throw ABinaryFileEx("Invalid Decode parameter"); }
+	
+	ByteOrder::Decode(dest, &((uint8_t*)blob)[bytePos], count, width, order);
+};
+
+void ABinaryFile::Decode(uint64_t bytePos, uint64_t count, uint16_t* dest, ByteOrder::Endian order) const {
+	DecodeValues(bytePos, count, dest, sizeof(*dest), order);
+};
+
+void ABinaryFile::Decode(uint64_t bytePos, uint64_t count, int16_t* dest, ByteOrder::Endian order) const {
+	DecodeValues(bytePos, count, dest, sizeof(*dest), order);
+};
+
+void ABinaryFile::Decode(uint64_t bytePos, uint64_t count, uint32_t* dest, ByteOrder::Endian order) const {
+	DecodeValues(bytePos, count, dest, sizeof(*dest), order);
+};
+
+void ABinaryFile::Decode(uint64_t bytePos, uint64_t count, int32_t* dest, ByteOrder::Endian order) const {
+	DecodeValues(bytePos, count, dest, sizeof(*dest), order);
+};
+
+void ABinaryFile::Decode(uint64_t bytePos, uint64_t count, uint64_t* dest, ByteOrder::Endian order) const {
+	DecodeValues(bytePos, count, dest, sizeof(*dest), order);
+};
+
+void ABinaryFile::Decode(uint64_t bytePos, uint64_t count, int64_t* dest, ByteOrder::Endian order) const {
+	DecodeValues(bytePos, count, dest, sizeof(*dest), order);
+};
+
+// IEEE floats are byte swapped exactly as integers of the same size.
+void ABinaryFile::Decode(uint64_t bytePos, uint64_t count, float* dest, ByteOrder::Endian order) const {
+	DecodeValues(bytePos, count, dest, sizeof(*dest), order);
+};
 
-	return *ptr;
+void ABinaryFile::Decode(uint64_t bytePos, uint64_t count, double* dest, ByteOrder::Endian order) const {
+	DecodeValues(bytePos, count, dest, sizeof(*dest), order);
 };
 
+//----
+
 const void* ABinaryFile::Blob() const {
 	return blob;
 };
 
+bool ABinaryFile::IsMapped() const {
+	return store && store->kind == BlobKind::mapped;
+};
+
+ABinaryFile::LoadStats ABinaryFile::LoadInfo() const {
+	return loadStats;
+};
+
+bool ABinaryFile::IsBorrowed() const {
+	return store && store->kind == BlobKind::borrowed;
+};
+
+void ABinaryFile::Advise(AccessHint hint) const {
+	if (!IsMapped()) { return; }
+	
+	int advice = MADV_NORMAL;
+	switch (hint) {
+		case AccessHint::normal: advice = MADV_NORMAL; break;
+		case AccessHint::sequential: advice = MADV_SEQUENTIAL; break;
+		case AccessHint::random: advice = MADV_RANDOM; break;
+		case AccessHint::willNeed: advice = MADV_WILLNEED; break;
+	}
+	// Only a hint. Failure is not an error.
+	madvise(blob, size, advice);
+};
+
+//---------------------------------------------------------------
+#pragma mark - Search
+
+int64_t ABinaryFile::Find(const void* pattern, uint64_t len, uint64_t from) const {
+	if (from >= size) { return -1; }
+	int64_t pos = ByteSearch::Find((const uint8_t*)blob + from, size - from, pattern, len);
+	return pos < 0 ? -1 : pos + from;
+};
+
+int64_t ABinaryFile::Find(const std::string& pattern, uint64_t from) const {
+	return Find(pattern.data(), pattern.size(), from);
+};
+
+std::vector<uint64_t> ABinaryFile::FindAll(const void* pattern, uint64_t len, uint64_t from) const {
+	std::vector<uint64_t> found;
+	if (from < size) {
+		ByteSearch::FindAll((const uint8_t*)blob + from, size - from, pattern, len, found, from);
+	}
+	return found;
+};
+
+std::vector<uint64_t> ABinaryFile::FindAll(const std::string& pattern, uint64_t from) const {
+	return FindAll(pattern.data(), pattern.size(), from);
+};
+
+uint64_t ABinaryFile::Count(const void* pattern, uint64_t len) const {
+	return ByteSearch::Count(blob, size, pattern, len);
+};
+
+uint64_t ABinaryFile::Count(const std::string& pattern) const {
+	return Count(pattern.data(), pattern.size());
+};
+
+std::vector<ByteSearch::Match> ABinaryFile::FindAll(ByteSearch::MultiPattern& patterns) const {
+	DebugPretty
+	
+	return patterns.FindAll(blob, size);
+};
+
 //---------------------------------------------------------------
 #pragma mark - ABigBinaryFile
 
@@ -235,26 +550,378 @@ ABigBinaryFile::ABigBinaryFile() {
 };
 */
 
-void ABigBinaryFile::BlockErase() {
-	if (blockArray) {
-		// Does nothing in this implementation.
-	}
+// Per-thread last block, for ThreadMode::concurrent. Indexed by instance ID so a
+// thread can use a few instances at once without them pushing each other out.
+struct LastBlock {
+	// instanceID. 0 is never used.
+	uint64_t owner;
+	uint64_t block;
+	const uint8_t* data;
+	const std::atomic<uint64_t>* tag;
+	
+	// Access pattern, for readahead. The last block moved to, by operator[] or Pin(),
+	// and the number of moves in a row between blocks with the same stride.
+	uint64_t seen;
+	int64_t stride;
+	unsigned streak;
+	int64_t aheadTo;
+};
+
+#define LastBlockEntries 8
+static thread_local LastBlock lastBlocks[LastBlockEntries];
+
+static uint64_t NextInstanceID() {
+	static std::atomic<uint64_t> next(1);
+	return next++;
 };
 
 //----
 
-void ABigBinaryFile::ZeroSection(uint64_t section) {
-	DebugPrint(__PRETTY_FUNCTION__ + std::to_string(section), true);
+unsigned LatencyHistogram::Bucket(uint64_t ns) {
+	if (ns == 0) { return 0; }
+	unsigned b = 63 - __builtin_clzll(ns);
+	return b < bucketCount ? b : bucketCount - 1;
+};
+
+void LatencyHistogram::Clear() {
+	for (unsigned t = 0; t < bucketCount; t++) { buckets[t] = 0; }
+};
+
+uint64_t LatencyHistogram::Count() const {
+	uint64_t ct = 0;
+	for (unsigned t = 0; t < bucketCount; t++) { ct += buckets[t]; }
+	return ct;
+};
+
+uint64_t LatencyHistogram::Percentile(double f) const {
+	uint64_t total = Count();
+	if (total == 0) { return 0; }
 	
-	if (zeroBlocks) {
-		// Last block's size is not necessarily equal to block size
-		if (section == blockCount - 1) {
-			bzero(blockArray[section], LastBlockSize());
+	uint64_t want = (uint64_t)(f * total + 0.5);
+	if (want == 0) { want = 1; }
+	uint64_t ct = 0;
+	for (unsigned t = 0; t < bucketCount; t++) {
+		ct += buckets[t];
+		if (ct >= want) { return (2ULL << t) - 1; }
+	}
+	return (2ULL << (bucketCount - 1)) - 1;
+};
+
+// Relaxed atomics. Shared with the prefetcher thread, which may outlive a move.
+struct ABigBinaryFileCounters {
+	std::atomic<uint64_t> reads;
+	std::atomic<uint64_t> bytesRead;
+	std::atomic<uint64_t> writes;
+	std::atomic<uint64_t> bytesWritten;
+	std::atomic<uint64_t> prefetched;
+	std::atomic<uint64_t> loadLatency[LatencyHistogram::bucketCount];
+	
+	ABigBinaryFileCounters() { Reset(); }
+	
+	void Reset() {
+		reads.store(0, std::memory_order_relaxed);
+		bytesRead.store(0, std::memory_order_relaxed);
+		writes.store(0, std::memory_order_relaxed);
+		bytesWritten.store(0, std::memory_order_relaxed);
+		prefetched.store(0, std::memory_order_relaxed);
+		for (auto& B : loadLatency) { B.store(0, std::memory_order_relaxed); }
+	};
+	
+	void Read(uint64_t bytes) {
+		reads.fetch_add(1, std::memory_order_relaxed);
+		bytesRead.fetch_add(bytes, std::memory_order_relaxed);
+	};
+	
+	void Write(uint64_t bytes) {
+		writes.fetch_add(1, std::memory_order_relaxed);
+		bytesWritten.fetch_add(bytes, std::memory_order_relaxed);
+	};
+};
+
+// pread() until len bytes are read, end of file or an error.
+// Returns bytes read, or -1 with errno set. Counted in counters if not nullptr.
+static int64_t ReadAt(int desc, void* dest, uint64_t len, uint64_t pos, ABigBinaryFileCounters* counters) {
+	uint8_t* p = (uint8_t*)dest;
+	uint64_t done = 0;
+	while (done < len) {
+		ssize_t ct = pread(desc, p + done, len - done, pos + done);
+		if (counters) { counters->Read(ct > 0 ? ct : 0); }
+		if (ct < 0 && errno == EINTR) { continue; }
+		// An O_DIRECT descriptor refuses the unaligned read after a short one at end of file.
+		if (ct < 0 && errno == EINVAL && done > 0) { break; }
+		if (ct < 0) { return -1; }
+		if (ct == 0) { break; }
+		done += ct;
+	}
+	return done;
+};
+
+#ifndef IOV_MAX
+	#define IOV_MAX 1024
+#endif
+
+// preadv() is only on macOS 11 and later. Before that read the first buffer with pread().
+// Callers already loop on a short read.
+static ssize_t PReadV(int desc, const struct iovec* iov, int count, uint64_t pos) {
+#ifdef __APPLE__
+	if (__builtin_available(macOS 11.0, iOS 14.0, *)) { return preadv(desc, iov, count, pos); }
+	return pread(desc, iov->iov_base, iov->iov_len, pos);
+#else
+	return preadv(desc, iov, count, pos);
+#endif
+};
+
+// preadv() until every buffer in iov is full. Returns false with errno set on an error
+// or early end of file. iov is modified.
+static bool ReadAtV(int desc, struct iovec* iov, int count, uint64_t pos, ABigBinaryFileCounters* counters) {
+	while (count > 0) {
+		ssize_t ct = PReadV(desc, iov, count, pos);
+		counters->Read(ct > 0 ? ct : 0);
+		if (ct < 0 && errno == EINTR) { continue; }
+		if (ct <= 0) {
+			if (ct == 0) { errno = EIO; }
+			return false;
 		}
-		else {
-			bzero(blockArray[section], blockSize);
+		pos += ct;
+		while (count > 0 && (size_t)ct >= iov->iov_len) {
+			ct -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char*)iov->iov_base + ct;
+			iov->iov_len -= ct;
+		}
+	}
+	return true;
+};
+
+// As PReadV(), for pwritev(). Callers already loop on a short write.
+static ssize_t PWriteV(int desc, const struct iovec* iov, int count, uint64_t pos) {
+#ifdef __APPLE__
+	if (__builtin_available(macOS 11.0, iOS 14.0, *)) { return pwritev(desc, iov, count, pos); }
+	return pwrite(desc, iov->iov_base, iov->iov_len, pos);
+#else
+	return pwritev(desc, iov, count, pos);
+#endif
+};
+
+// pwritev() until every buffer in iov is written. Returns false with errno set on an
+// error. iov is modified.
+static bool WriteAtV(int desc, struct iovec* iov, int count, uint64_t pos, ABigBinaryFileCounters* counters) {
+	while (count > 0) {
+		ssize_t ct = PWriteV(desc, iov, count, pos);
+		counters->Write(ct > 0 ? ct : 0);
+		if (ct < 0 && errno == EINTR) { continue; }
+		if (ct <= 0) {
+			if (ct == 0) { errno = EIO; }
+			return false;
+		}
+		pos += ct;
+		while (count > 0 && (size_t)ct >= iov->iov_len) {
+			ct -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char*)iov->iov_base + ct;
+			iov->iov_len -= ct;
+		}
+	}
+	return true;
+};
+
+// Read block blkNum into a slot of cache, under key. The caller holds the shard lock if
+// the cache is shared. Throws FileAccessEx, after freeing the slot.
+// evicted is as for ABlockCache::Insert().
+static uint8_t* FillBlock(ABlockCache& cache, uint64_t key, int desc, uint64_t blkNum, uint64_t blockSize,
+			bool lastBlock, bool zero, ABigBinaryFileCounters* counters, int64_t& evicted) {
+	uint8_t* ptr = cache.Insert(key, evicted);
+	if (!ptr) { throw ABinaryFile::ABinaryFileEx("Every block is pinned"); }
+	if (cache.Mapped()) {
+		if (!cache.MapFile(ptr, desc, blkNum * blockSize)) {
+			cache.Remove(key);
+			throw ABinaryFile::FileAccessEx("Could not map file. Block load failed (" + std::to_string(errno) + ")");
+		}
+		cache.Filled(ptr);
+		return ptr;
+	}
+	if (zero) { bzero(ptr, blockSize); }
+	
+	int64_t ct = ReadAt(desc, ptr, blockSize, blkNum * blockSize, counters);
+	if (ct < 0) {
+		cache.Remove(key);
+		throw ABinaryFile::FileAccessEx("Could not read file. Block load failed (" + std::to_string(errno) + ")");
+	}
+	if (ct < (int64_t)blockSize && !lastBlock) {
+		cache.Remove(key);
+		throw ABinaryFile::FileAccessEx("Could not load all data");
+	}
+	cache.Filled(ptr);
+	return ptr;
+};
+
+//----
+
+struct ABigBinaryFile::Prefetcher {
+	CacheShard* shards;
+	unsigned shardCount;
+	// As the owner's.
+	uint64_t keyBase;
+	uint64_t shardSalt;
+	ABigBinaryFileCounters* counters;
+	int desc;
+	uint64_t blockSize;
+	// Most blocks worth queueing. More would evict the first before they are read.
+	uint64_t capacity;
+	// Updated by the owner.
+	std::atomic<uint64_t> blockCount;
+	std::atomic<bool> zero;
+	
+	std::mutex lock;
+	std::condition_variable wake;
+	std::deque<uint64_t> queue;
+	bool stop;
+	std::thread thread;
+	
+	// Throws std::system_error if the thread can not be started.
+	Prefetcher(CacheShard* shards, unsigned shardCount, uint64_t keyBase, uint64_t shardSalt,
+				ABigBinaryFileCounters* counters, int desc, uint64_t blockSize, uint64_t capacity,
+				uint64_t blockCount, bool zero)
+			: shards(shards), shardCount(shardCount), keyBase(keyBase), shardSalt(shardSalt),
+			counters(counters), desc(desc), blockSize(blockSize),
+			capacity(capacity), blockCount(blockCount), zero(zero), stop(false) {
+		thread = std::thread(&Prefetcher::Run, this);
+	};
+	
+	~Prefetcher() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stop = true;
+		}
+		wake.notify_one();
+		thread.join();
+	};
+	
+	// Queue count blocks from first, stride apart.
+	void Request(uint64_t first, int64_t stride, uint64_t count) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			for (uint64_t t = 0; t < count && queue.size() < capacity; t++) {
+				queue.push_back(first + stride * (int64_t)t);
+			}
+		}
+		wake.notify_one();
+	};
+	
+	void Cancel() {
+		std::lock_guard<std::mutex> guard(lock);
+		queue.clear();
+	};
+	
+	void Run() {
+		for (;;) {
+			uint64_t blkNum;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				wake.wait(guard, [this]() { return stop || !queue.empty(); });
+				if (stop) { return; }
+				blkNum = queue.front();
+				queue.pop_front();
+			}
+			
+			uint64_t count = blockCount;
+			if (blkNum >= count) { continue; }
+			CacheShard& shard = shards[(blkNum + shardSalt) % shardCount];
+			std::lock_guard<std::mutex> guard(shard.lock);
+			// Not Find(). A block nobody has read yet should not look recently used.
+			if (shard.cache->Contains(keyBase + blkNum)) { continue; }
+			try {
+				int64_t evicted;
+				uint8_t* ptr = FillBlock(*shard.cache, keyBase + blkNum, desc, blkNum, blockSize, blkNum == count - 1, zero, counters, evicted);
+				shard.cache->Prefetched(ptr);
+				counters->prefetched.fetch_add(1, std::memory_order_relaxed);
+			}
+			catch (const ABinaryFile::ABinaryFileEx&) {
+				// The reader will get the error when it reads the block.
+			}
+		}
+	};
+};
+
+//----
+
+struct ABigBinaryFile::AsyncLoads {
+	typedef std::function<void(uint64_t, bool)> Callback;
+	
+	// Callbacks for each slot being read.
+	std::mutex lock;
+	std::unordered_map<const uint8_t*, std::vector<Callback>> waiting;
+	// Slots being read in each shard.
+	std::unordered_map<const void*, uint64_t> reading;
+	// Last, so it is destroyed, waiting for its reads, first.
+	AsyncBlockLoader loader;
+	
+	AsyncLoads() : loader(128) {}
+	
+	std::vector<Callback> Take(const void* shard, const uint8_t* slot) {
+		std::lock_guard<std::mutex> guard(lock);
+		std::vector<Callback> callbacks;
+		auto itr = waiting.find(slot);
+		if (itr != waiting.end()) {
+			callbacks.swap(itr->second);
+			waiting.erase(itr);
+		}
+		reading[shard]--;
+		return callbacks;
+	};
+};
+
+//----
+
+void ABigBinaryFile::CreateCache() {
+	DebugPretty
+	
+	if (sharedCache) {
+		owner = sharedCache->Join();
+		shards = sharedCache->Shards();
+		shardCount = sharedCache->ShardCount();
+	}
+	else {
+		owner = 0;
+		shardCount = 1;
+		if (threadMode == ThreadMode::concurrent) {
+			// Several shards per thread keeps two threads wanting the same lock rare.
+			unsigned hw = std::thread::hardware_concurrency();
+			shardCount = (hw ? hw : 1) * 4;
+			if (shardCount > maxBlocks) { shardCount = (unsigned)maxBlocks; }
 		}
+		
+		ownShards = NewShards(mapped);
+		shards = ownShards.get();
+	}
+	keyBase = ASharedBlockCache::Key(owner, 0);
+	// Else every file's block 0, often a header, would be in the first shard.
+	shardSalt = owner * 0x9E3779B1ULL;
+	
+	counters.reset(new ABigBinaryFileCounters);
+	
+	// New cache, so nothing any thread remembers applies to it.
+	instanceID = NextInstanceID();
+};
+
+std::unique_ptr<ABigBinaryFile::CacheShard[]> ABigBinaryFile::NewShards(bool mapped) const {
+	std::unique_ptr<CacheShard[]> fresh(new CacheShard[shardCount]);
+	for (unsigned t = 0; t < shardCount; t++) {
+		uint64_t slots = maxBlocks / shardCount + (t < maxBlocks % shardCount ? 1 : 0);
+		fresh[t].cache.reset(new ABlockCache(blockSize, slots, policy, mapped));
 	}
+	return fresh;
+};
+
+void ABigBinaryFile::ReleaseCache() {
+	if (sharedCache && owner) { sharedCache->Leave(owner); }
+	owner = 0;
 };
 
 //----
@@ -262,17 +929,79 @@ void ABigBinaryFile::ZeroSection(uint64_t section) {
 void ABigBinaryFile::DataReset() {
 	DebugPretty
 	
+	// Never lose writes. They go over whatever changed the file.
+	Flush();
 	currentPtr = nullptr;
 	currBlockNum = -1;
 	
-//	BlockErase();
-	for (uint64_t t = 0; t < maxBlocks; t++) {
-		freeSections[t] = false;
-		ZeroSection(t);
+	if (prefetcher) { prefetcher->Cancel(); }
+	if (!shards) { return; }
+	if (sharedCache) {
+		sharedCache->Purge(owner);
+		return;
+	}
+	for (unsigned t = 0; t < shardCount; t++) {
+		std::lock_guard<std::mutex> guard(shards[t].lock);
+		shards[t].cache->Clear(zeroBlocks);
+	}
+};
+
+void ABigBinaryFile::DataAppended(uint64_t oldSize) {
+	DebugPretty
+	
+	if (oldSize % blockSize == 0) { return; }
+	if (dirtyBlocks.count(oldSize / blockSize)) { Flush(); }
+	uint64_t blkNum = oldSize / blockSize;
+	if (currBlockNum == (int64_t)blkNum) {
+		currentPtr = nullptr;
+		currBlockNum = -1;
+	}
+	// Other threads' last block entries see the slot's tag change.
+	CacheShard& shard = ShardFor(blkNum);
+	std::lock_guard<std::mutex> guard(shard.lock);
+	shard.cache->Remove(Key(blkNum));
+};
+
+bool ABigBinaryFile::SetWatched(bool yes) {
+	DebugPretty
+	
+	if (yes == Watched()) { return true; }
+	if (!yes) {
+		Unwatch();
+		return true;
 	}
 	
-	blockNumAddrMap.clear();
-	blkNumberHistory.clear();
+	try {
+		watcher = AFileWatcher::Global();
+	}
+	catch (const ABinaryFile::ABinaryFileEx&) {
+		return false;
+	}
+	watch = fileDesc > STDERR_FILENO ? watcher->Add(fileDesc) : watcher->Add(path);
+	if (!watch) {
+		watcher.reset();
+		return false;
+	}
+	// Anything before the watch started is unseen, so check once.
+	watch->dirty = true;
+	return true;
+};
+
+void ABigBinaryFile::Unwatch() {
+	if (watch) { watcher->Remove(watch); }
+	watch.reset();
+	watcher.reset();
+};
+
+bool ABigBinaryFile::FileCheckIfChanged() {
+	if (watch && !watch->gone.load(std::memory_order_relaxed)) {
+		// A plain load in the common case. Cleared before the check, so a change
+		// during it is seen next time.
+		if (!watch->dirty.load(std::memory_order_relaxed)) { return false; }
+		if (!watch->dirty.exchange(false, std::memory_order_acquire)) { return false; }
+	}
+	FileCheck();
+	return true;
 };
 
 //----
@@ -302,19 +1031,30 @@ void ABigBinaryFile::FileCheck() {
 		throw ABinaryFile::ABinaryFileEx(std::string("Not a file"));
 	}
 	
-	if (lastCheck.tv_sec == LONG_MIN) {
-		lastCheck = s.st_mtimespec;
-	}
-	else {
-		if (lastCheck.tv_sec < s.st_mtimespec.tv_sec
-				|| (lastCheck.tv_sec == s.st_mtimespec.tv_sec && lastCheck.tv_nsec < s.st_mtimespec.tv_nsec)) {
+	lastChange = FileChange::none;
+	if (lastCheck.tv_sec != LONG_MIN) {
+		bool modified = lastCheck.tv_sec < s.st_mtimespec.tv_sec
+				|| (lastCheck.tv_sec == s.st_mtimespec.tv_sec && lastCheck.tv_nsec < s.st_mtimespec.tv_nsec);
+		if (follow && (uint64_t)s.st_size > dataSize) {
+			// Taken to be appended to. Only the old last block can be out of date.
+			DataAppended(dataSize);
+			lastChange = FileChange::appended;
+		}
+		else if (modified || (follow && (uint64_t)s.st_size < dataSize)) {
 			// modification date change
 			DataReset();
+			lastChange = FileChange::replaced;
 		}
 	}
+	// Else the next change would be seen on every check after it.
+	lastCheck = s.st_mtimespec;
 	
 	dataSize = s.st_size;
 	blockCount = dataSize > 0 ? (dataSize - 1) / blockSize + 1 : 0;
+	if (owner && (uint64_t)blockCount >> ASharedBlockCache::blockBits) {
+		throw ABinaryFile::ABinaryFileEx("Too many blocks for a shared cache");
+	}
+	if (prefetcher) { prefetcher->blockCount = blockCount; }
 
 #ifdef DebugBinaryDetailed
 	if (fileDesc > STDERR_FILENO) {
@@ -328,7 +1068,7 @@ void ABigBinaryFile::FileCheck() {
 
 //----
 
-ABigBinaryFile::ABigBinaryFile(int desc, uint16_t blockSz, uint64_t maxBlks) {
+ABigBinaryFile::ABigBinaryFile(int desc, uint32_t blockSz, uint64_t maxBlks, ThreadMode mode, EvictionPolicy policy) {
 	DebugPrintFmt("%p ", this);DebugPretty
 	
 	if (desc <= STDERR_FILENO) { throw ABinaryFile::ABinaryFileEx("Invalid file descriptor"); }
@@ -337,20 +1077,25 @@ ABigBinaryFile::ABigBinaryFile(int desc, uint16_t blockSz, uint64_t maxBlks) {
 	dataSize = 0;
 	fileDesc = desc;
 	path.clear();
+	readDesc = -1;
+	directDesc = -1;
+	writeDesc = -1;
+	mapped = false;
 	blockSize = blockSz;
 	blockCount = 0;
 	maxBlocks = maxBlks;
-	file = nullptr;
+	threadMode = mode;
+	this->policy = policy;
+	readahead = 0;
+	follow = false;
+	lastChange = FileChange::none;
+	zeroBlocks = false;
 	currentPtr = nullptr;
 	currBlockNum = -1;
 	lastCheck.tv_nsec = 0;
 	lastCheck.tv_sec = LONG_MIN;
 	
-	blockArray = (char**)calloc(maxBlks, blockSize);
-	if (!blockArray) { throw ABinaryFile::ABinaryFileEx("Block array memory failure"); }
-	for (uint64_t t = 0; t < maxBlks; t++) {
-		freeSections.push_back(false);
-	}
+	CreateCache();
 	
 	FileCheck();
 	OpenFile();
@@ -358,34 +1103,121 @@ ABigBinaryFile::ABigBinaryFile(int desc, uint16_t blockSz, uint64_t maxBlks) {
 
 //----
 
-ABigBinaryFile::ABigBinaryFile(const std::string& path, uint16_t blockSz, uint64_t maxBlks) {
+ABigBinaryFile::ABigBinaryFile(const std::string& path, uint32_t blockSz, uint64_t maxBlks, ThreadMode mode, EvictionPolicy policy) {
 	DebugPrintFmt("%p ", this);DebugPretty
 	
 	if (maxBlks == 0) { throw ABinaryFile::ABinaryFileEx("Zero maximum blocks"); }
 	dataSize = 0;
 	fileDesc = -1;
 	this->path = path;
+	readDesc = -1;
+	directDesc = -1;
+	writeDesc = -1;
+	mapped = false;
 	blockSize = blockSz;
 	blockCount = 0;
 	maxBlocks = maxBlks;
-	file = nullptr;
+	threadMode = mode;
+	this->policy = policy;
+	readahead = 0;
+	follow = false;
+	lastChange = FileChange::none;
+	zeroBlocks = false;
 	currentPtr = nullptr;
 	currBlockNum = -1;
 	lastCheck.tv_nsec = 0;
 	lastCheck.tv_sec = LONG_MIN;
 	
-	blockArray = (char**)calloc(maxBlks, blockSize);
-	if (!blockArray) { throw ABinaryFile::ABinaryFileEx("Block array memory failure"); }
-	for (uint64_t t = 0; t < maxBlks; t++) {
-		freeSections.push_back(false);
-		blockArray[t] = (char*)calloc(1, blockSize);
-		if (!blockArray[t]) {throw ABinaryFile::ABinaryFileEx("Block array item memory failure"); }
-	}
+	CreateCache();
 	
 	FileCheck();
 	OpenFile();
 };
 
+//----
+
+ABigBinaryFile::ABigBinaryFile(int desc, std::shared_ptr<ASharedBlockCache> cache) {
+	DebugPrintFmt("%p ", this);DebugPretty
+	
+	if (desc <= STDERR_FILENO) { throw ABinaryFile::ABinaryFileEx("Invalid file descriptor"); }
+	if (!cache) { throw ABinaryFile::ABinaryFileEx("No shared cache"); }
+	if (cache->BlockSize() > UINT32_MAX) { throw ABinaryFile::ABinaryFileEx("Shared cache block size too large"); }
+	
+	dataSize = 0;
+	fileDesc = desc;
+	path.clear();
+	readDesc = -1;
+	directDesc = -1;
+	writeDesc = -1;
+	mapped = false;
+	blockSize = (uint32_t)cache->BlockSize();
+	blockCount = 0;
+	maxBlocks = cache->Capacity();
+	threadMode = ThreadMode::concurrent;
+	policy = cache->EvictionPolicy();
+	sharedCache = cache;
+	readahead = 0;
+	follow = false;
+	lastChange = FileChange::none;
+	zeroBlocks = false;
+	currentPtr = nullptr;
+	currBlockNum = -1;
+	lastCheck.tv_nsec = 0;
+	lastCheck.tv_sec = LONG_MIN;
+	
+	CreateCache();
+	
+	try {
+		FileCheck();
+		OpenFile();
+	}
+	catch (...) {
+		// No destructor call to give the owner number back.
+		ReleaseCache();
+		throw;
+	}
+};
+
+ABigBinaryFile::ABigBinaryFile(const std::string& path, std::shared_ptr<ASharedBlockCache> cache) {
+	DebugPrintFmt("%p ", this);DebugPretty
+	
+	if (!cache) { throw ABinaryFile::ABinaryFileEx("No shared cache"); }
+	if (cache->BlockSize() > UINT32_MAX) { throw ABinaryFile::ABinaryFileEx("Shared cache block size too large"); }
+	
+	dataSize = 0;
+	fileDesc = -1;
+	this->path = path;
+	readDesc = -1;
+	directDesc = -1;
+	writeDesc = -1;
+	mapped = false;
+	blockSize = (uint32_t)cache->BlockSize();
+	blockCount = 0;
+	maxBlocks = cache->Capacity();
+	threadMode = ThreadMode::concurrent;
+	policy = cache->EvictionPolicy();
+	sharedCache = cache;
+	readahead = 0;
+	follow = false;
+	lastChange = FileChange::none;
+	zeroBlocks = false;
+	currentPtr = nullptr;
+	currBlockNum = -1;
+	lastCheck.tv_nsec = 0;
+	lastCheck.tv_sec = LONG_MIN;
+	
+	CreateCache();
+	
+	try {
+		FileCheck();
+		OpenFile();
+	}
+	catch (...) {
+		ReleaseCache();
+		throw;
+	}
+};
+
 // Copy constructor
 ABigBinaryFile::ABigBinaryFile(const ABigBinaryFile& obj) {
 	DebugPrintFmt("%p ", this);DebugPretty
@@ -393,51 +1225,77 @@ ABigBinaryFile::ABigBinaryFile(const ABigBinaryFile& obj) {
 	dataSize = obj.dataSize;
 	fileDesc = obj.fileDesc;
 	path = obj.path;
+	readDesc = -1;
+	directDesc = -1;
+	writeDesc = -1;
+	mapped = obj.mapped;
 	blockSize = obj.blockSize;
 	blockCount = obj.blockCount;
 	maxBlocks = obj.maxBlocks;
-	file = nullptr;
+	threadMode = obj.threadMode;
+	policy = obj.policy;
+	sharedCache = obj.sharedCache;
+	readahead = obj.readahead;
+	follow = obj.follow;
+	lastChange = FileChange::none;
+	zeroBlocks = obj.zeroBlocks;
 	currentPtr = nullptr;
 	currBlockNum = -1;
 	lastCheck = obj.lastCheck;
 	
-	blockArray = (char**)calloc(maxBlocks, blockSize);
-	if (!blockArray) { throw ABinaryFile::ABinaryFileEx("Block array memory failure"); }
-	for (uint64_t t = 0; t < maxBlocks; t++) {
-		freeSections.push_back(false);
-		blockArray[t] = (char*)calloc(1, blockSize);
-		if (!blockArray[t]) {throw ABinaryFile::ABinaryFileEx("Block array item memory failure"); }
-	}
+	CreateCache();
 	
-	FileCheck();
-	OpenFile();
+	try {
+		FileCheck();
+		OpenFile();
+	}
+	catch (...) {
+		ReleaseCache();
+		throw;
+	}
+	if (obj.DirectIO()) { SetDirectIO(true); }
+	if (obj.Watched()) { SetWatched(true); }
+	if (readahead) { StartPrefetcher(); }
 };
 
 // Assignment operator
-ABigBinaryFile ABigBinaryFile::operator=(const ABigBinaryFile& obj) {
+ABigBinaryFile& ABigBinaryFile::operator=(const ABigBinaryFile& obj) {
 	DebugPrintFmt("%p ", this);DebugPretty
 	
+	if (this == &obj) { return *this; }
+	// Before the cache and descriptor they use go.
+	asyncLoads.reset();
+	prefetcher.reset();
+	DropWrites();
+	Unwatch();
+	ReleaseCache();
+	CloseFile();
+	
 	dataSize = obj.dataSize;
 	fileDesc = obj.fileDesc;
 	path = obj.path;
+	mapped = obj.mapped;
 	blockSize = obj.blockSize;
 	blockCount = obj.blockCount;
 	maxBlocks = obj.maxBlocks;
-	file = nullptr;
+	threadMode = obj.threadMode;
+	policy = obj.policy;
+	sharedCache = obj.sharedCache;
+	readahead = obj.readahead;
+	follow = obj.follow;
+	lastChange = FileChange::none;
+	zeroBlocks = obj.zeroBlocks;
 	currentPtr = nullptr;
 	currBlockNum = -1;
 	lastCheck = obj.lastCheck;
 	
-	blockArray = (char**)calloc(maxBlocks, blockSize);
-	if (!blockArray) { throw ABinaryFile::ABinaryFileEx("Block array memory failure"); }
-	for (uint64_t t = 0; t < maxBlocks; t++) {
-		freeSections.push_back(false);
-		blockArray[t] = (char*)calloc(1, blockSize);
-		if (!blockArray[t]) {throw ABinaryFile::ABinaryFileEx("Block array item memory failure"); }
-	}
+	CreateCache();
 	
 	FileCheck();
 	OpenFile();
+	if (obj.DirectIO()) { SetDirectIO(true); }
+	if (obj.Watched()) { SetWatched(true); }
+	if (readahead) { StartPrefetcher(); }
 	
 	return *this;
 };
@@ -452,57 +1310,118 @@ ABigBinaryFile::ABigBinaryFile(ABigBinaryFile&& ref) {
 	ref.fileDesc = -1;
 	path = ref.path;
 	ref.path.clear();
-	file = ref.file;
-	ref.file = nullptr;
+	readDesc = ref.readDesc;
+	ref.readDesc = -1;
+	directDesc = ref.directDesc;
+	mapped = ref.mapped;
+	ref.directDesc = -1;
+	writeDesc = ref.writeDesc;
+	ref.writeDesc = -1;
+	dirtyBlocks = std::move(ref.dirtyBlocks);
+	ref.dirtyBlocks.clear();
+	shardDirty = std::move(ref.shardDirty);
+	ref.shardDirty.clear();
 	
 	blockSize = ref.blockSize;
 	blockCount = ref.blockCount;
 	maxBlocks = ref.maxBlocks;
-	blockArray = ref.blockArray;
-	ref.blockArray = nullptr;
-	
-	blockNumAddrMap = ref.blockNumAddrMap;
-	blkNumberHistory = ref.blkNumberHistory;
-	freeSections = ref.freeSections;
-	
-	lastCheck = ref.lastCheck;
+	threadMode = ref.threadMode;
+	policy = ref.policy;
+	zeroBlocks = ref.zeroBlocks;
+	ownShards = std::move(ref.ownShards);
+	sharedCache = std::move(ref.sharedCache);
+	shards = ref.shards;
+	ref.shards = nullptr;
+	shardCount = ref.shardCount;
+	owner = ref.owner;
+	ref.owner = 0;
+	keyBase = ref.keyBase;
+	shardSalt = ref.shardSalt;
+	counters = std::move(ref.counters);
+	// The cache came too, so per-thread entries for it are still good.
+	instanceID = ref.instanceID;
+	ref.instanceID = NextInstanceID();
+	prefetcher = std::move(ref.prefetcher);
+	readahead = ref.readahead;
+	ref.readahead = 0;
+	follow = ref.follow;
+	lastChange = ref.lastChange;
+	asyncLoads = std::move(ref.asyncLoads);
+	watcher = std::move(ref.watcher);
+	watch = std::move(ref.watch);
 	
 	currentPtr = ref.currentPtr;
 	currBlockNum = ref.currBlockNum;
 	lastCheck = ref.lastCheck;
 	
-	
+	ref.currentPtr = nullptr;
+	ref.currBlockNum = -1;
 };
 
 // Move assignment operator
 ABigBinaryFile& ABigBinaryFile::operator=(ABigBinaryFile&& ref) {
 	DebugPrintFmt("%p ", this);DebugPretty
 	
+	if (this == &ref) { return *this; }
+	asyncLoads.reset();
+	prefetcher.reset();
+	DropWrites();
+	Unwatch();
+	ReleaseCache();
+	CloseFile();
+	
 	dataSize = ref.dataSize;
 	fileDesc = ref.fileDesc;
 	
 	ref.fileDesc = -1;
 	path = ref.path;
 	ref.path.clear();
-	file = ref.file;
-	ref.file = nullptr;
+	readDesc = ref.readDesc;
+	ref.readDesc = -1;
+	directDesc = ref.directDesc;
+	mapped = ref.mapped;
+	ref.directDesc = -1;
+	writeDesc = ref.writeDesc;
+	ref.writeDesc = -1;
+	dirtyBlocks = std::move(ref.dirtyBlocks);
+	ref.dirtyBlocks.clear();
+	shardDirty = std::move(ref.shardDirty);
+	ref.shardDirty.clear();
 	
 	blockSize = ref.blockSize;
 	blockCount = ref.blockCount;
 	maxBlocks = ref.maxBlocks;
-	blockArray = ref.blockArray;
-	ref.blockArray = nullptr;
-	
-	blockNumAddrMap = ref.blockNumAddrMap;
-	blkNumberHistory = ref.blkNumberHistory;
-	freeSections = ref.freeSections;
-	
-	lastCheck = ref.lastCheck;
+	threadMode = ref.threadMode;
+	policy = ref.policy;
+	zeroBlocks = ref.zeroBlocks;
+	ownShards = std::move(ref.ownShards);
+	sharedCache = std::move(ref.sharedCache);
+	shards = ref.shards;
+	ref.shards = nullptr;
+	shardCount = ref.shardCount;
+	owner = ref.owner;
+	ref.owner = 0;
+	keyBase = ref.keyBase;
+	shardSalt = ref.shardSalt;
+	counters = std::move(ref.counters);
+	instanceID = ref.instanceID;
+	ref.instanceID = NextInstanceID();
+	prefetcher = std::move(ref.prefetcher);
+	readahead = ref.readahead;
+	ref.readahead = 0;
+	follow = ref.follow;
+	lastChange = ref.lastChange;
+	asyncLoads = std::move(ref.asyncLoads);
+	watcher = std::move(ref.watcher);
+	watch = std::move(ref.watch);
 	
 	currentPtr = ref.currentPtr;
 	currBlockNum = ref.currBlockNum;
 	lastCheck = ref.lastCheck;
 	
+	ref.currentPtr = nullptr;
+	ref.currBlockNum = -1;
+	
 	return *this;
 };
 
@@ -512,14 +1431,12 @@ ABigBinaryFile::~ABigBinaryFile() {
 	DebugPrintFmt("%p ", this);
 	DebugPretty
 	
-	if (file) { fclose(file); }
-	BlockErase();
-	if (blockArray) {
-		for (uint64_t t=0; t < maxBlocks; t++) {
-			free(blockArray[t]);
-		}
-		free(blockArray);
-	}
+	asyncLoads.reset();
+	prefetcher.reset();
+	DropWrites();
+	Unwatch();
+	ReleaseCache();
+	CloseFile();
 };
 
 //-----------------------
@@ -528,69 +1445,166 @@ ABigBinaryFile::~ABigBinaryFile() {
 void ABigBinaryFile::OpenFile() {
 	DebugPretty
 	
-	if (file) { return; }
+	if (readDesc >= 0) { return; }
 	if (fileDesc > STDERR_FILENO) {
-		file = fdopen(fileDesc, "r");
+		readDesc = fileDesc;
 	}
 	else {
-		file = fopen(path.c_str(), "r");
+		readDesc = open(path.c_str(), O_RDONLY);
 	}
-	if (!file) {
+	if (readDesc < 0) {
 		throw ABinaryFile::ABinaryFileEx("Could not open data file");
 	}
 };
 
-//----
+// Only closes what OpenFile() or SetDirectIO() opened.
+void ABigBinaryFile::CloseFile() {
+	if (readDesc >= 0 && readDesc != fileDesc) { close(readDesc); }
+	readDesc = -1;
+	if (directDesc >= 0) { close(directDesc); }
+	directDesc = -1;
+	if (writeDesc >= 0 && writeDesc != fileDesc) { close(writeDesc); }
+	writeDesc = -1;
+};
 
-// Assumes caller has checked against blockCount
-void ABigBinaryFile::LoadBlock(uint64_t blkNum) {
-	DebugPretty
-	
-	if (blockNumAddrMap.find(blkNum) != blockNumAddrMap.end()) { return; }
+//----
 
-#ifdef DebugBinaryDetailed
-	printf("Loading block %llu\n", blkNum);
+// Open path for reads that bypass the page cache. -1 if not possible.
+static int OpenDirect(const std::string& path) {
+#if defined(O_DIRECT)
+	return open(path.c_str(), O_RDONLY | O_DIRECT);
+#elif defined(F_NOCACHE)
+	int desc = open(path.c_str(), O_RDONLY);
+	if (desc >= 0 && fcntl(desc, F_NOCACHE, 1) < 0) {
+		close(desc);
+		desc = -1;
+	}
+	return desc;
+#else
+	return -1;
 #endif
+};
 
-	if (blockNumAddrMap.size() == maxBlocks) {
-		uint64_t oldest = blkNumberHistory[0];
-		
-#ifdef DebugBinaryDetailed
-		printf("Purging block %llu\n", oldest);
-#endif
-		
-		auto itr = blockNumAddrMap.find(oldest);
-		assert(itr != blockNumAddrMap.end());
-		uint64_t bidx = itr->second;
-		ZeroSection(bidx);
+bool ABigBinaryFile::SetDirectIO(bool yes) {
+	DebugPretty
+	
+	if (yes == DirectIO()) { return true; }
+	
+	int desc = -1;
+	if (yes) {
+		if (path.empty() || mapped || blockSize % ABlockCache::PageSize() != 0) { return false; }
+		desc = OpenDirect(path);
+		if (desc < 0) { return false; }
 		
-		freeSections[bidx] = false;
-		blockNumAddrMap.erase(itr);
-		blkNumberHistory.erase(blkNumberHistory.begin());
+		// Some file systems take the flag, then refuse the reads.
+		if (dataSize > 0) {
+			void* buffer = nullptr;
+			if (posix_memalign(&buffer, ABlockCache::PageSize(), blockSize) != 0) {
+				close(desc);
+				return false;
+			}
+			int64_t ct = ReadAt(desc, buffer, blockSize, 0, nullptr);
+			free(buffer);
+			if (ct < 0) {
+				close(desc);
+				return false;
+			}
+		}
 	}
 	
-	auto itr = std::find(freeSections.begin(), freeSections.end(), false);
-	assert(itr != freeSections.end());
+	// Reads already queued use the old descriptor, as does the prefetcher.
+	WaitAsync();
+	bool restart = prefetcher != nullptr;
+	prefetcher.reset();
+	if (directDesc >= 0) { close(directDesc); }
+	directDesc = desc;
+	if (restart) { StartPrefetcher(); }
+	
+	return true;
+};
+
+bool ABigBinaryFile::SetMapped(bool yes) {
+	DebugPretty
+	
+	if (yes == mapped) { return true; }
+	// A reader without the lock could touch a window while another thread unmaps it.
+	if (yes && (sharedCache || Shared() || DirectIO() || Writable() || blockSize % ABlockCache::PageSize() != 0)) { return false; }
 	
-	uint64_t idx = itr - freeSections.begin();
-	fpos_t pos = blkNum * blockSize;
-	int res = fsetpos(file, &pos);
-	if (res) {
-		throw ABinaryFile::FileAccessEx("Could not set file position. Block load failed");
+	WaitAsync();
+	// A PinnedBlock or iterator would be left pointing into freed slots.
+	for (unsigned t = 0; t < shardCount; t++) {
+		std::lock_guard<std::mutex> guard(shards[t].lock);
+		if (shards[t].cache->AnyPinned()) { return false; }
 	}
-	size_t ct = fread(blockArray[idx], 1, blockSize, file);
 	
-	if (ct < blockSize && blkNum != blockCount - 1) {
-		throw ABinaryFile::FileAccessEx("Could not load all data");
+	// Made before anything changes, so running out of address space leaves the old cache.
+	std::unique_ptr<CacheShard[]> fresh;
+	try {
+		fresh = NewShards(yes);
+	}
+	catch (const ABinaryFile::ABinaryFileEx&) {
+		return false;
+	}
+	
+	// Everything using the old shards goes with them. Not shared, so no prefetcher.
+	currentPtr = nullptr;
+	currBlockNum = -1;
+	
+	mapped = yes;
+	ownShards = std::move(fresh);
+	shards = ownShards.get();
+	counters.reset(new ABigBinaryFileCounters);
+	// New cache, so nothing any thread remembers applies to it.
+	instanceID = NextInstanceID();
+	if (!yes && readahead) { StartPrefetcher(); }
+	
+	return true;
+};
+
+//----
+
+// Assumes caller has checked against blockCount
+char* ABigBinaryFile::LoadBlock(uint64_t blkNum) {
+	DebugPretty
+	
+	CacheShard& shard = ShardFor(blkNum);
+	ABlockCache& cache = *shard.cache;
+	uint8_t* ptr = cache.Find(Key(blkNum));
+	// Only a slot LoadBlocksAsync() is still reading into is found unfilled.
+	while (ptr && asyncLoads && cache.Tag(ptr).load(std::memory_order_acquire) != Key(blkNum) + 1) {
+		shard.filled.wait(shard.lock);
+		ptr = (uint8_t*)cache.Peek(Key(blkNum));
 	}
+	if (ptr) { return (char*)ptr; }
+
+#ifdef DebugBinaryDetailed
+	printf("Loading block %llu\n", blkNum);
+#endif
 	
-	freeSections[idx] = true;
-	blkNumberHistory.push_back(blkNum);
-	blockNumAddrMap[blkNum] = idx;
+	auto start = std::chrono::steady_clock::now();
+	int64_t evicted;
+	ptr = FillBlock(cache, Key(blkNum), LoadDesc(), blkNum, blockSize, blkNum == blockCount - 1, zeroBlocks, counters.get(), evicted);
+	uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	counters->loadLatency[LatencyHistogram::Bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+	// Its slot now belongs to blkNum.
+	if (!Shared() && evicted >= 0 && evicted == currBlockNum) {
+		currentPtr = nullptr;
+		currBlockNum = -1;
+	}
 	
 #ifdef DebugBinaryDetailed
 	printf("Block %llu loaded\n", blkNum);
 #endif
+	return (char*)ptr;
+};
+
+template<class P> void ABigBinaryFile::WithBlock(uint64_t blkNum, P proc) {
+	if (!Shared()) {
+		proc(LoadBlock(blkNum));
+		return;
+	}
+	std::lock_guard<std::mutex> guard(ShardFor(blkNum).lock);
+	proc(LoadBlock(blkNum));
 };
 
 //----
@@ -599,7 +1613,258 @@ void ABigBinaryFile::Preload(uint64_t blockNumber) {
 	DebugPretty
 	
 	if (blockNumber >= blockCount) { return; }
-	LoadBlock(blockNumber);
+	WithBlock(blockNumber, [](char*) {});
+};
+
+//----
+
+void ABigBinaryFile::WatchStride(uint64_t blkNum) {
+	LastBlock& last = lastBlocks[instanceID % LastBlockEntries];
+	if (last.owner != instanceID) {
+		// Taken over from another instance, with no block remembered yet.
+		last.owner = instanceID;
+		last.block = UINT64_MAX;
+		last.seen = blkNum;
+		last.stride = 0;
+		last.streak = 0;
+		last.aheadTo = blkNum;
+		return;
+	}
+	if (blkNum == last.seen) { return; }
+	
+	int64_t stride = (int64_t)blkNum - (int64_t)last.seen;
+	last.seen = blkNum;
+	if (!readahead) { return; }
+	if (stride == last.stride) {
+		last.streak++;
+	}
+	else {
+		last.stride = stride;
+		last.streak = 1;
+		last.aheadTo = blkNum;
+	}
+	if (last.streak >= 2) { ReadAhead(blkNum, stride, last.aheadTo); }
+};
+
+uint8_t ABigBinaryFile::SharedByte(uint64_t blkNum, uint32_t idx) {
+	// This thread's last block, if its slot still holds it. The tag is checked
+	// either side of the read in case another thread reuses the slot meanwhile.
+	LastBlock& last = lastBlocks[instanceID % LastBlockEntries];
+	if (last.owner == instanceID && last.block == blkNum) {
+		uint64_t tag = last.tag->load(std::memory_order_acquire);
+		if (tag == Key(blkNum) + 1) {
+			uint8_t v = __atomic_load_n(last.data + idx, __ATOMIC_RELAXED);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (last.tag->load(std::memory_order_relaxed) == tag) { return v; }
+		}
+	}
+	
+	WatchStride(blkNum);
+	
+	CacheShard& shard = ShardFor(blkNum);
+	std::lock_guard<std::mutex> guard(shard.lock);
+	const uint8_t* data = (const uint8_t*)LoadBlock(blkNum);
+	last.block = blkNum;
+	last.data = data;
+	last.tag = &shard.cache->Tag(data);
+	return data[idx];
+};
+
+//----
+
+void ABigBinaryFile::StartPrefetcher() {
+	DebugPretty
+	
+	// Mapping a window is quick, and the kernel reads ahead within it. Nor may a
+	// mapped cache be shared, see SetMapped().
+	if (prefetcher || mapped) { return; }
+	try {
+		prefetcher.reset(new Prefetcher(shards, shardCount, keyBase, shardSalt, counters.get(), LoadDesc(), blockSize, maxBlocks, blockCount, zeroBlocks));
+	}
+	catch (const std::system_error&) {
+		// No thread, no readahead. Everything else works as before.
+		return;
+	}
+	// The cache is shared from now on, so the unlocked single thread pointer must go.
+	currentPtr = nullptr;
+	currBlockNum = -1;
+};
+
+void ABigBinaryFile::SetReadahead(uint64_t blocks) {
+	DebugPretty
+	
+	readahead = std::min(blocks, maxBlocks / 2);
+	if (readahead) { StartPrefetcher(); }
+	else { prefetcher.reset(); }
+};
+
+void ABigBinaryFile::ReadAhead(uint64_t blkNum, int64_t stride, int64_t& aheadTo) {
+	if (!prefetcher) { return; }
+	
+	int64_t target = (int64_t)blkNum + stride * (int64_t)readahead;
+	// Continue from whatever was queued last time.
+	int64_t from = stride > 0 ? std::max(aheadTo, (int64_t)blkNum) : std::min(aheadTo, (int64_t)blkNum);
+	aheadTo = target;
+	
+	// Clip to the file.
+	if (target < 0) { target = 0; }
+	if (target >= blockCount) { target = blockCount - 1; }
+	int64_t count = (target - from) / stride;
+	if (count > 0) { prefetcher->Request(from + stride, stride, count); }
+};
+
+void ABigBinaryFile::PrefetchRange(uint64_t start, uint64_t len) {
+	DebugPretty
+	
+	if (len == 0 || start >= dataSize) { return; }
+	StartPrefetcher();
+	if (!prefetcher) { return; }
+	
+	uint64_t end = std::min(start + len, dataSize) - 1;
+	uint64_t first = start / blockSize;
+	prefetcher->Request(first, 1, end / blockSize - first + 1);
+};
+
+ABigBinaryFile::PinnedBlock ABigBinaryFile::Pin(uint64_t blockNumber) {
+	DebugPretty
+	
+	if (blockNumber >= blockCount) { throw ABinaryFile::ABinaryFileEx("Bad block number"); }
+	
+	// Block by block loops are watched for a stride, as operator[] is.
+	if (prefetcher) { WatchStride(blockNumber); }
+	
+	uint64_t len = blockNumber == blockCount - 1 ? LastBlockSize() : blockSize;
+	PinnedBlock pinned;
+	WithBlock(blockNumber, [&](char* block) {
+		ABlockCache& cache = *ShardFor(blockNumber).cache;
+		cache.Pin((const uint8_t*)block);
+		pinned = PinnedBlock(&cache.PinCount((const uint8_t*)block), (const uint8_t*)block, len, blockNumber, blockNumber * blockSize);
+	});
+	return pinned;
+};
+
+void ABigBinaryFile::LoadBlocksAsync(const std::vector<uint64_t>& blockNumbers, std::function<void(uint64_t, bool)> done) {
+	DebugPretty
+	
+	if (mapped) {
+		// Mapping is quick, and the kernel reads the pages in the background. Done here,
+		// as loader threads would make the cache shared.
+		for (uint64_t blkNum : blockNumbers) {
+			bool ok = blkNum < blockCount;
+			if (ok) {
+				try {
+					WithBlock(blkNum, [this](char* ptr) { madvise(ptr, blockSize, MADV_WILLNEED); });
+				}
+				catch (const ABinaryFile::ABinaryFileEx&) { ok = false; }
+			}
+			done(blkNum, ok);
+		}
+		return;
+	}
+	
+	if (!asyncLoads) {
+		asyncLoads.reset(new AsyncLoads);
+		// The cache is shared from now on, so the unlocked single thread pointer must go.
+		currentPtr = nullptr;
+		currBlockNum = -1;
+	}
+	
+	// Copied into the read callbacks, which must not use this object.
+	AsyncLoads* loads = asyncLoads.get();
+	ABigBinaryFileCounters* counts = counters.get();
+	uint64_t size = blockSize;
+	uint64_t count = blockCount;
+	
+	std::vector<AsyncBlockLoader::Read> reads;
+	// Reported once the reads are queued.
+	std::vector<std::pair<uint64_t, bool>> now;
+	
+	for (uint64_t blkNum : blockNumbers) {
+		if (blkNum >= count) {
+			now.push_back(std::make_pair(blkNum, false));
+			continue;
+		}
+		
+		CacheShard* shard = &ShardFor(blkNum);
+		uint64_t key = Key(blkNum);
+		std::lock_guard<std::mutex> guard(shard->lock);
+		ABlockCache& cache = *shard->cache;
+		const uint8_t* held = cache.Peek(key);
+		if (held && cache.Tag(held).load(std::memory_order_acquire) == key + 1) {
+			now.push_back(std::make_pair(blkNum, true));
+			continue;
+		}
+		if (held) {
+			// Already being read.
+			std::lock_guard<std::mutex> wait(loads->lock);
+			loads->waiting[held].push_back(done);
+			continue;
+		}
+		
+		std::lock_guard<std::mutex> wait(loads->lock);
+		// At most half the shard's slots are read into at once, else other readers could
+		// find every block in it pinned.
+		uint8_t* ptr = nullptr;
+		if (loads->reading[shard] < cache.Capacity() / 2) {
+			int64_t evicted;
+			ptr = cache.Insert(key, evicted);
+		}
+		if (!ptr) {
+			now.push_back(std::make_pair(blkNum, false));
+			continue;
+		}
+		// Kept until the read is done with, whatever happens to the cache meanwhile.
+		cache.Pin(ptr);
+		if (zeroBlocks) { bzero(ptr, blockSize); }
+		loads->waiting[ptr].push_back(done);
+		loads->reading[shard]++;
+		
+		bool last = blkNum == count - 1;
+		reads.push_back({LoadDesc(), ptr, size, blkNum * size, [=](int64_t ct) {
+			counts->Read(ct > 0 ? ct : 0);
+			bool ok = ct == (int64_t)size || (last && ct >= 0);
+			std::vector<AsyncLoads::Callback> report;
+			{
+				std::lock_guard<std::mutex> guard(shard->lock);
+				ABlockCache& cache = *shard->cache;
+				// Reset() dropped it while it was read.
+				if (cache.Peek(key) != ptr) { ok = false; }
+				else if (ok) { cache.Filled(ptr); }
+				else { cache.Remove(key); }
+				cache.PinCount(ptr).fetch_sub(1, std::memory_order_release);
+				report = loads->Take(shard, ptr);
+				shard->filled.notify_all();
+			}
+			for (auto& R : report) { R(blkNum, ok); }
+		}});
+	}
+	
+	loads->loader.Submit(reads);
+	for (auto& N : now) { done(N.first, N.second); }
+};
+
+void ABigBinaryFile::WaitAsync() {
+	DebugPretty
+	
+	if (asyncLoads) { asyncLoads->loader.Wait(); }
+};
+
+uint8_t ABigBinaryFile::ByteIterator::Load() const {
+	Release();
+	if (pos >= file->dataSize) { throw ABinaryFile::ABinaryFileEx("Out of range"); }
+	PinnedBlock P = file->Pin(pos / file->blockSize);
+	// Keep the pin after P goes.
+	pin = P.pin;
+	P.pin = nullptr;
+	data = P.data;
+	start = P.position;
+	end = P.position + P.size;
+	return data[pos - start];
+};
+
+void ABigBinaryFile::SkipZeroing(bool yes) {
+	zeroBlocks = yes;
+	if (prefetcher) { prefetcher->zero = yes; }
 };
 
 //----
@@ -613,12 +1878,14 @@ uint8_t ABigBinaryFile::operator[](uint64_t pos) {
 	if (pos >= dataSize) { throw ABinaryFile::ABinaryFileEx("Out of range"); }
 	
 	uint64_t blkNum = pos / blockSize;
-	uint16_t idx = pos % blockSize;
+	uint32_t idx = (uint32_t)(pos % blockSize);
 
 #if DebugBinaryDetailed == 2
 	printf("Getting byte at %llu. Block number %llu, block index %llu\n", pos, blkNum, idx);
 #endif
 
+	if (Shared()) { return SharedByte(blkNum, idx); }
+	
 	// Help speed things up.
 	if (blkNum == currBlockNum) {
 #if DebugBinaryDetailed == 2
@@ -628,19 +1895,15 @@ uint8_t ABigBinaryFile::operator[](uint64_t pos) {
 		return currentPtr[idx];
 	}
 	
-	LoadBlock(blkNum);
-	
+	currentPtr = LoadBlock(blkNum);
 	currBlockNum = blkNum;
-	// This should not fail
-	uint64_t arrayIdx = blockNumAddrMap[blkNum];
-	currentPtr = blockArray[arrayIdx];
 
 #if DebugBinaryDetailed == 2
-	int v = blockArray[arrayIdx][idx];
+	int v = currentPtr[idx];
 	printf("\tByte = %d\n", v);
 #endif
 	
-	return blockArray[arrayIdx][idx];
+	return currentPtr[idx];
 };
 
 uint64_t ABigBinaryFile::Size() const {
@@ -650,7 +1913,7 @@ uint64_t ABigBinaryFile::Size() const {
 //----
 
 // Block Size
-uint16_t ABigBinaryFile::BlockSize() const {
+uint32_t ABigBinaryFile::BlockSize() const {
 	return blockSize;
 };
 
@@ -659,14 +1922,19 @@ uint16_t ABigBinaryFile::BlockSize() const {
 // Number of bytes for the last block of a file.
 // This is most likely not the block size.
 // blockCount * blockSize does not necessarily equal file size.
-uint16_t ABigBinaryFile::LastBlockSize() const {
+uint32_t ABigBinaryFile::LastBlockSize() const {
 	DebugPretty
 
+	if (dataSize == 0) { return 0; }
+	// A file that is an exact multiple of the block size has a full last block.
+	uint32_t sz = (uint32_t)(dataSize % blockSize);
+	if (sz == 0) { sz = blockSize; }
+
 #if DebugBinaryDetailed == 2
-	printf("Last block size is %llu\n", dataSize % blockSize);
+	printf("Last block size is %u\n", sz);
 #endif
 
-	return dataSize % blockSize;
+	return sz;
 };
 
 //----
@@ -676,34 +1944,99 @@ uint64_t ABigBinaryFile::BlockCount() const {
 	return blockCount;
 };
 
-uint16_t ABigBinaryFile::CopyToBlob(void* dest, uint16_t size, uint64_t blockNumber) const {
+bool ABigBinaryFile::BlockIsLoaded(uint64_t blockNumber) const {
+	CacheShard& shard = ShardFor(blockNumber);
+	std::lock_guard<std::mutex> guard(shard.lock);
+	return shard.cache->Contains(Key(blockNumber));
+};
+
+// Next to be evicted first, shard by shard.
+std::vector<uint64_t> ABigBinaryFile::LoadedBlocks() const {
+	std::vector<uint64_t> blocks;
+	for (unsigned t = 0; t < shardCount; t++) {
+		std::lock_guard<std::mutex> guard(shards[t].lock);
+		for (uint64_t key : shards[t].cache->Blocks()) {
+			if (ASharedBlockCache::OwnerOf(key) == owner) { blocks.push_back(ASharedBlockCache::BlockOf(key)); }
+		}
+	}
+	return blocks;
+};
+
+//----
+
+double ABigBinaryFile::CacheStats::HitRatio() const {
+	uint64_t total = hits + misses;
+	return total ? (double)hits / total : 0;
+};
+
+double ABigBinaryFile::CacheStats::PrefetchUsefulness() const {
+	return prefetched ? (double)prefetchUsed / prefetched : 0;
+};
+
+ABigBinaryFile::CacheStats ABigBinaryFile::Stats() const {
+	CacheStats stats;
+	stats.hits = stats.misses = stats.evictions = stats.prefetchUsed = 0;
+	for (unsigned t = 0; t < shardCount; t++) {
+		std::lock_guard<std::mutex> guard(shards[t].lock);
+		const ABlockCache& cache = *shards[t].cache;
+		stats.hits += cache.Hits();
+		stats.misses += cache.Misses();
+		stats.evictions += cache.Evictions();
+		stats.prefetchUsed += cache.PrefetchHits();
+	}
+	
+	stats.prefetched = counters->prefetched.load(std::memory_order_relaxed);
+	stats.reads = counters->reads.load(std::memory_order_relaxed);
+	stats.bytesRead = counters->bytesRead.load(std::memory_order_relaxed);
+	stats.writes = counters->writes.load(std::memory_order_relaxed);
+	stats.bytesWritten = counters->bytesWritten.load(std::memory_order_relaxed);
+	for (unsigned t = 0; t < LatencyHistogram::bucketCount; t++) {
+		stats.loadLatency.buckets[t] = counters->loadLatency[t].load(std::memory_order_relaxed);
+	}
+	return stats;
+};
+
+void ABigBinaryFile::ResetStats() {
+	DebugPretty
+	
+	for (unsigned t = 0; t < shardCount; t++) {
+		std::lock_guard<std::mutex> guard(shards[t].lock);
+		shards[t].cache->ResetCounts();
+	}
+	counters->Reset();
+};
+
+uint32_t ABigBinaryFile::CopyToBlob(void* dest, uint32_t size, uint64_t blockNumber) const {
 	DebugPretty
 	DebugPrintFmt("Copy block# %llu to %p. %d bytes maximum\n", blockNumber, dest, size);
 	
 	if (!dest || blockNumber >= blockCount) { throw ABinaryFile::ABinaryFileEx("Invalid CopyToBlob parameter"); }
 	bzero(dest, size);
 	
-	auto itr = blockNumAddrMap.find(blockNumber);
-	if (itr != blockNumAddrMap.end()) {
-		// Use local store
-		uint16_t maxSizeRead = size > blockSize ? blockSize : size;
-		if (blockNumber == blockCount - 1) {
-			if (maxSizeRead > (dataSize % blockSize)) { maxSizeRead = (dataSize % blockSize); }
+	{
+		CacheShard& shard = ShardFor(blockNumber);
+		std::lock_guard<std::mutex> guard(shard.lock);
+		const uint8_t* ptr = shard.cache->Peek(Key(blockNumber));
+		if (ptr && shard.cache->Tag(ptr).load(std::memory_order_acquire) == Key(blockNumber) + 1) {
+			// Use local store
+			uint32_t maxSizeRead = size > blockSize ? blockSize : size;
+			if (blockNumber == blockCount - 1) {
+				if (maxSizeRead > LastBlockSize()) { maxSizeRead = LastBlockSize(); }
+			}
+			
+			memcpy(dest, ptr, maxSizeRead);
+			
+			return maxSizeRead;
 		}
-		
-		char* ptr = blockArray[itr->second];
-		memcpy(dest, ptr, maxSizeRead);
-		
-		return maxSizeRead;
 	}
 	
-	fpos_t sz = blockNumber * blockSize;
-	if (fsetpos(file, &sz)) {
+	// Never read into the next block.
+	int64_t ct = ReadAt(readDesc, dest, size > blockSize ? blockSize : size, blockNumber * blockSize, counters.get());
+	if (ct < 0) {
 		std::string s = "Could not copy bytes from file (" + std::to_string(errno) + ")";
 		throw ABinaryFile::ABinaryFileEx(s);
 	}
-	return fread(dest, 1, size, file);
-	
+	return (uint32_t)ct;
 };
 
 //----
@@ -715,16 +2048,8 @@ void* ABigBinaryFile::CopyBlock_F(uint64_t blockNumber) {
 	if (blockNumber >= blockCount) { throw ABinaryFile::ABinaryFileEx("Bad block number"); }
 	char* ptr = (char*)malloc(blockSize);
 	bzero(ptr, blockSize);
-	LoadBlock(blockNumber);
-	
-	uint64_t arrayIdx = blockNumAddrMap[blockNumber];
-	if (blockNumber == blockCount - 1) {
-		uint64_t sz = dataSize % blockSize;
-		memcpy(ptr, blockArray[arrayIdx], sz);
-	}
-	else {
-		memcpy(ptr, blockArray[arrayIdx], blockSize);
-	}
+	uint64_t sz = blockNumber == blockCount - 1 ? LastBlockSize() : blockSize;
+	WithBlock(blockNumber, [&](char* block) { memcpy(ptr, block, sz); });
 	
 	DebugPrint("\tBlock %llu copied\n", blockNumber);
 	return ptr;
@@ -738,14 +2063,14 @@ void* ABigBinaryFile::AllData() const {
 	
 	char* ptr = (char*)malloc(dataSize);
 	if (ptr) {
-		fpos_t sz = 0;
-		if (fsetpos(file, &sz)) {
+		if (ReadAt(readDesc, ptr, dataSize, 0, counters.get()) != (int64_t)dataSize) {
 			free(ptr);
 			return nullptr;
 		}
-		if (fread(ptr, dataSize, 1, file) == 0) {
-			free(ptr);
-			return nullptr;
+		// Not yet in the file.
+		for (auto& D : dirtyBlocks) {
+			uint64_t len = D.first == (uint64_t)blockCount - 1 ? LastBlockSize() : blockSize;
+			memcpy(ptr + D.first * blockSize, D.second, len);
 		}
 	}
 	return ptr;
@@ -758,4 +2083,297 @@ void ABigBinaryFile::Reset() {
 	
 	DataReset();
 	FileCheck();
+	lastChange = FileChange::replaced;
+};
+
+//---------------------------------------------------------------
+#pragma mark - Writing
+
+bool ABigBinaryFile::SetWritable(bool yes) {
+	DebugPretty
+	
+	if (yes == Writable()) { return true; }
+	if (!yes) {
+		Flush();
+		if (writeDesc != fileDesc) { close(writeDesc); }
+		writeDesc = -1;
+		return true;
+	}
+	
+	if (mapped) { return false; }
+	if (fileDesc > STDERR_FILENO) {
+		int flags = fcntl(fileDesc, F_GETFL);
+		if (flags < 0 || (flags & O_ACCMODE) == O_RDONLY) { return false; }
+		writeDesc = fileDesc;
+	}
+	else {
+		writeDesc = open(path.c_str(), O_WRONLY);
+	}
+	return writeDesc >= 0;
+};
+
+void ABigBinaryFile::Write(uint64_t pos, const void* data, uint64_t len) {
+	DebugPretty
+	
+	if (!Writable()) { throw ABinaryFile::ABinaryFileEx("Not writable"); }
+	if (pos > dataSize || len > dataSize - pos) { throw ABinaryFile::ABinaryFileEx("Out of range"); }
+	
+	if (shardDirty.empty()) { shardDirty.assign(shardCount, 0); }
+	const uint8_t* src = (const uint8_t*)data;
+	while (len > 0) {
+		uint64_t blkNum = pos / blockSize;
+		uint64_t offset = pos % blockSize;
+		uint64_t ct = std::min<uint64_t>(len, blockSize - offset);
+		
+		auto itr = dirtyBlocks.find(blkNum);
+		if (itr != dirtyBlocks.end()) {
+			memcpy(itr->second + offset, src, ct);
+		}
+		else {
+			// Leave room for readers. Per shard, as a block can only go in its own.
+			// A shard of one slot is written through.
+			unsigned S = ShardOf(blkNum);
+			uint64_t limit = shards[S].cache->Capacity() / 2;
+			if (limit && shardDirty[S] >= limit) { Flush(); }
+			WithBlock(blkNum, [&](char* block) {
+				memcpy(block + offset, src, ct);
+				// Pinned until written back, so never evicted.
+				shards[S].cache->Pin((const uint8_t*)block);
+				dirtyBlocks[blkNum] = (uint8_t*)block;
+				shardDirty[S]++;
+			});
+			if (!limit) { Flush(); }
+		}
+		pos += ct;
+		src += ct;
+		len -= ct;
+	}
+};
+
+void ABigBinaryFile::Flush(bool sync) {
+	DebugPretty
+	
+	if (dirtyBlocks.empty()) { return; }
+	
+	// A change by anyone else since the last check must still be seen by FileCheck().
+	struct stat s;
+	bool current = fstat(writeDesc, &s) == 0 && s.st_mtimespec.tv_sec == lastCheck.tv_sec && s.st_mtimespec.tv_nsec == lastCheck.tv_nsec;
+	
+	std::vector<struct iovec> iov;
+	auto itr = dirtyBlocks.begin();
+	while (itr != dirtyBlocks.end()) {
+		// A run of blocks that follow each other in the file is one pwritev().
+		auto first = itr;
+		uint64_t next = itr->first;
+		iov.clear();
+		while (itr != dirtyBlocks.end() && itr->first == next && iov.size() < IOV_MAX) {
+			uint64_t len = next == (uint64_t)blockCount - 1 ? LastBlockSize() : blockSize;
+			iov.push_back({ itr->second, len });
+			next++;
+			itr++;
+		}
+		if (!WriteAtV(writeDesc, iov.data(), (int)iov.size(), first->first * blockSize, counters.get())) {
+			// This run and those after it stay dirty.
+			throw ABinaryFile::FileAccessEx("Could not write file (" + std::to_string(errno) + ")");
+		}
+		while (first != itr) {
+			ShardFor(first->first).cache->PinCount(first->second).fetch_sub(1, std::memory_order_release);
+			shardDirty[ShardOf(first->first)]--;
+			first = dirtyBlocks.erase(first);
+		}
+	}
+	
+	if (sync) {
+#ifdef __APPLE__
+		int res = fsync(writeDesc);
+#else
+		int res = fdatasync(writeDesc);
+#endif
+		if (res != 0) { throw ABinaryFile::FileAccessEx("Could not sync file (" + std::to_string(errno) + ")"); }
+	}
+	
+	// These writes are not a change to the file.
+	if (current && fstat(writeDesc, &s) == 0) { lastCheck = s.st_mtimespec; }
+};
+
+void ABigBinaryFile::DropWrites() {
+	try {
+		Flush();
+	}
+	catch (const ABinaryFile::ABinaryFileEx&) {
+		// Nobody to tell.
+	}
+	for (auto& D : dirtyBlocks) {
+		ShardFor(D.first).cache->PinCount(D.second).fetch_sub(1, std::memory_order_release);
+	}
+	dirtyBlocks.clear();
+	shardDirty.clear();
+};
+
+//---------------------------------------------------------------
+#pragma mark - Range read
+
+bool ABigBinaryFile::CopyCached(uint64_t blkNum, uint64_t offset, void* dest, uint64_t len) {
+	CacheShard& shard = ShardFor(blkNum);
+	std::lock_guard<std::mutex> guard(shard.lock);
+	const uint8_t* ptr = shard.cache->Find(Key(blkNum));
+	// Not yet read, by LoadBlocksAsync().
+	if (!ptr || shard.cache->Tag(ptr).load(std::memory_order_acquire) != Key(blkNum) + 1) { return false; }
+	memcpy(dest, ptr + offset, len);
+	return true;
+};
+
+uint64_t ABigBinaryFile::Read(uint64_t pos, void* dest, uint64_t len) {
+	return ReadV({{pos, dest, len}});
+};
+
+uint64_t ABigBinaryFile::ReadV(const std::vector<Extent>& extents) {
+	DebugPretty
+	
+	// Parts not in the cache. File position, destination and length.
+	struct Run {
+		uint64_t pos;
+		uint8_t* dest;
+		uint64_t len;
+	};
+	std::vector<Run> runs;
+	uint64_t total = 0;
+	
+	for (const Extent& E : extents) {
+		if (E.pos > dataSize) { throw ABinaryFile::ABinaryFileEx("Out of range"); }
+		uint64_t end = E.len < dataSize - E.pos ? E.pos + E.len : dataSize;
+		if (end == E.pos) { continue; }
+		total += end - E.pos;
+		
+		uint8_t* out = (uint8_t*)E.dest;
+		for (uint64_t blk = E.pos / blockSize; blk <= (end - 1) / blockSize; blk++) {
+			uint64_t blkStart = blk * blockSize;
+			uint64_t from = std::max(E.pos, blkStart);
+			uint64_t to = std::min(end, blkStart + blockSize);
+			uint8_t* dest = out + (from - E.pos);
+			
+			if (CopyCached(blk, from - blkStart, dest, to - from)) { continue; }
+			
+			// Extend the previous run if it ends here, in the file and in memory.
+			if (!runs.empty() && runs.back().pos + runs.back().len == from && runs.back().dest + runs.back().len == dest) {
+				runs.back().len += to - from;
+			}
+			else {
+				runs.push_back({from, dest, to - from});
+			}
+		}
+	}
+	
+	// Runs that follow on in the file become one preadv().
+	std::sort(runs.begin(), runs.end(), [](const Run& A, const Run& B) { return A.pos < B.pos; });
+	std::vector<struct iovec> iov;
+	for (size_t t = 0; t < runs.size(); ) {
+		uint64_t pos = runs[t].pos;
+		uint64_t next = pos;
+		iov.clear();
+		while (t < runs.size() && runs[t].pos == next && iov.size() < IOV_MAX) {
+			iov.push_back({runs[t].dest, (size_t)runs[t].len});
+			next += runs[t].len;
+			t++;
+		}
+		if (!ReadAtV(readDesc, iov.data(), (int)iov.size(), pos, counters.get())) {
+			throw ABinaryFile::FileAccessEx("Could not read file (" + std::to_string(errno) + ")");
+		}
+	}
+	
+	return total;
+};
+
+//---------------------------------------------------------------
+#pragma mark - Search
+
+void ABigBinaryFile::ScanBlocks(uint64_t from, uint64_t keep, const std::function<bool(const uint8_t*, uint64_t, uint64_t)>& proc) {
+	DebugPretty
+	
+	if (from >= dataSize) { return; }
+	
+	std::vector<uint8_t> window(keep + blockSize);
+	uint8_t* buffer = window.data();
+	uint64_t carry = 0;
+	// File position of the window's first byte.
+	uint64_t pos = from;
+	// Bytes of the first block before from.
+	uint64_t skip = from % blockSize;
+	
+	for (uint64_t blk = from / blockSize; blk < (uint64_t)blockCount; blk++) {
+		uint64_t got = CopyToBlob(buffer + carry, blockSize, blk);
+		if (got <= skip) { break; }
+		
+		const uint8_t* start = buffer + skip;
+		uint64_t len = carry + got - skip;
+		if (!proc(start, len, pos)) { return; }
+		
+		uint64_t next = len < keep ? len : keep;
+		memmove(buffer, start + len - next, next);
+		pos += len - next;
+		carry = next;
+		skip = 0;
+	}
+};
+
+//----
+
+int64_t ABigBinaryFile::Find(const void* pattern, uint64_t len, uint64_t from) {
+	if (len == 0) { return -1; }
+	
+	int64_t result = -1;
+	ScanBlocks(from, len - 1, [&](const uint8_t* p, uint64_t n, uint64_t pos) {
+		int64_t at = ByteSearch::Find(p, n, pattern, len);
+		if (at < 0) { return true; }
+		result = pos + at;
+		return false;
+	});
+	return result;
+};
+
+int64_t ABigBinaryFile::Find(const std::string& pattern, uint64_t from) {
+	return Find(pattern.data(), pattern.size(), from);
+};
+
+// The carried bytes are one short of a pattern, so no match is reported twice.
+std::vector<uint64_t> ABigBinaryFile::FindAll(const void* pattern, uint64_t len, uint64_t from) {
+	std::vector<uint64_t> found;
+	if (len == 0) { return found; }
+	
+	ScanBlocks(from, len - 1, [&](const uint8_t* p, uint64_t n, uint64_t pos) {
+		ByteSearch::FindAll(p, n, pattern, len, found, pos);
+		return true;
+	});
+	return found;
+};
+
+std::vector<uint64_t> ABigBinaryFile::FindAll(const std::string& pattern, uint64_t from) {
+	return FindAll(pattern.data(), pattern.size(), from);
+};
+
+uint64_t ABigBinaryFile::Count(const void* pattern, uint64_t len) {
+	if (len == 0) { return 0; }
+	
+	uint64_t count = 0;
+	ScanBlocks(0, len - 1, [&](const uint8_t* p, uint64_t n, uint64_t /*pos*/) {
+		count += ByteSearch::Count(p, n, pattern, len);
+		return true;
+	});
+	return count;
+};
+
+uint64_t ABigBinaryFile::Count(const std::string& pattern) {
+	return Count(pattern.data(), pattern.size());
+};
+
+// Nothing is carried, the automaton state is.
+std::vector<ByteSearch::Match> ABigBinaryFile::FindAll(ByteSearch::MultiPattern& patterns) {
+	std::vector<ByteSearch::Match> found;
+	ByteSearch::MultiPattern::State state = patterns.Start();
+	
+	ScanBlocks(0, 0, [&](const uint8_t* p, uint64_t n, uint64_t pos) {
+		state = patterns.Scan(state, p, n, pos, found);
+		return true;
+	});
+	return found;
 };
@@ -15,20 +15,126 @@
 #include <exception>
 #include <set>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include "ByteOrder.hpp"
+#include "ByteSearch.hpp"
+#include "BlockCache.hpp"
+#include "FileWatcher.hpp"
 
 // Define if you want detailed information during calls.
 // Note: CPPDebug has to be defined also.
 // #define DebugBinaryDetailed 1
 	// Set DebugBinaryDetailed to 2 if you want craps load of output.
 
+//---------------------------------------------
+// Non-owning view of a block of bytes.
+// It never allocates, copies or frees. Whoever created it is responsible for
+// keeping the memory alive for as long as the view (or anything built from it) is used.
+
+struct ByteSpan {
+	const uint8_t* data;
+	uint64_t size;
+	
+	ByteSpan() : data(nullptr), size(0) {}
+	ByteSpan(const void* data, uint64_t size) : data((const uint8_t*)data), size(size) {}
+	
+	bool empty() const { return size == 0; }
+	const uint8_t* begin() const { return data; }
+	const uint8_t* end() const { return data + size; }
+	
+	// No bounds check.
+	uint8_t operator[](uint64_t pos) const { return data[pos]; }
+};
+
 //---------------------------------------------
 // Class that loads a file into memory.
 // If is all-or-nothing. It will never write back to the original file.
+// The file can either be read into a malloc'ed block or mapped with mmap().
+// A mapped file is paged in by the system on demand and its pages are shared with
+// the page cache, so construction cost does not depend on file size.
+// It can also borrow memory that already exists (see ABinaryFile(ByteSpan)).
 
 class ABinaryFile {
+public:
+	// read	: file is read into a malloc'ed block in one go.
+	// mapped	: file is mmap'ed read only. Blob() points into the mapping.
+	// parallel	: file is read into a malloc'ed block in chunks, with concurrent
+	//			  pread() calls from several threads.
+	enum class LoadMode { read, mapped, parallel };
+	
+	// madvise() hint for mapped data. Ignored if the data is not mapped.
+	enum class AccessHint { normal, sequential, random, willNeed };
+	
+	// How the data was loaded and how long it took.
+	// Use it to compare LoadMode::read against LoadMode::parallel.
+	struct LoadStats {
+		LoadMode mode;
+		uint64_t bytes;
+		// Threads and chunks are 1 for LoadMode::read and 0 for LoadMode::mapped.
+		unsigned threads;
+		uint64_t chunks;
+		double seconds;
+		
+		double MBPerSecond() const { return seconds > 0 ? bytes / seconds / 1048576.0 : 0; }
+	};
+	
+private:
+	// How the data was obtained, and so how it must be released.
+	enum class BlobKind { none, heap, mapped, borrowed };
+	
+	// Owns the loaded data. Copies of an ABinaryFile share one BlobStore,
+	// so a copy costs a reference count increment. The data is never modified
+	// after loading, so no copy-on-write step is ever needed.
+	struct BlobStore {
+		void* data;
+		uint64_t size;
+		BlobKind kind;
+		
+		BlobStore(void* data, uint64_t size, BlobKind kind) : data(data), size(size), kind(kind) {}
+		BlobStore(const BlobStore&) = delete;
+		BlobStore& operator=(const BlobStore&) = delete;
+		// free() or munmap() depending on kind. Borrowed memory is left alone.
+		~BlobStore();
+	};
+	
+	std::shared_ptr<BlobStore> store;
+	// Cached from store.
 	void* blob;
 	uint64_t size;
 	
+	// Take ownership of data. Replaces any current store.
+	void Adopt(void* data, uint64_t length, BlobKind kind);
+	
+	LoadStats loadStats;
+	
+	// Map length bytes of desc. Returns false and leaves errno set on failure.
+	bool MapFile(int desc, uint64_t length, AccessHint hint);
+	
+	// Load length bytes of desc as mode says. Throws ABinaryFileEx. desc is not closed.
+	void Load(int desc, uint64_t length, LoadMode mode, AccessHint hint);
+	// Read length bytes of desc with pread(). Throws ABinaryFileEx. desc is not closed.
+	void ReadLoad(int desc, uint64_t length);
+	
+	// Read length bytes of desc with concurrent pread() calls.
+	// Throws ABinaryFileEx. desc is not closed.
+	void ParallelLoad(int desc, uint64_t length, unsigned threads, uint64_t chunkSize);
+	
+	// fstat() desc. Throws ABinaryFileEx if it fails or desc is not a file.
+	static uint64_t FileLength(int desc);
+	
+	// Drop this object's reference to the data.
+	// The data is released with the last reference.
+	void ReleaseBlob();
+	
+	// Shared by the Decode() overloads. width is the value size in bytes.
+	void DecodeValues(uint64_t bytePos, uint64_t count, void* dest, unsigned width, ByteOrder::Endian order) const;
+	
 	friend void Swap(ABinaryFile& A, ABinaryFile& B);
 protected:
 	// For use by subclasses
@@ -37,19 +143,44 @@ public:
 	// Keeping this so other class copy constructors will be happy
 	ABinaryFile();
 	
+	// A descriptor passed in is never closed, whatever the load mode. The file is read
+	// from position 0 with pread(), so the descriptor's file position is not used or
+	// changed, and mapped data stays valid after the caller closes it.
+	
 	// Can throw ABinaryFileEx
 	ABinaryFile(int desc);
 	
 	// Can throw ABinaryFileEx
 	ABinaryFile(const std::string& path);
 	
-	// Copy
+	// Can throw ABinaryFileEx
+	// LoadMode::read behaves as ABinaryFile(int).
+	ABinaryFile(int desc, LoadMode mode, AccessHint hint = AccessHint::normal);
+	
+	// Can throw ABinaryFileEx
+	// LoadMode::parallel uses the hardware thread count and picks the chunk size.
+	ABinaryFile(const std::string& path, LoadMode mode, AccessHint hint = AccessHint::normal);
+	
+	// Can throw ABinaryFileEx
+	// Parallel load (LoadMode::parallel). The file is split into chunks of chunkSize
+	// bytes which are read by threads threads.
+	// threads == 0 uses the hardware thread count. chunkSize == 0 picks a size from
+	// file size and thread count.
+	ABinaryFile(int desc, unsigned threads, uint64_t chunkSize = 0);
+	ABinaryFile(const std::string& path, unsigned threads, uint64_t chunkSize = 0);
+	
+	// Borrow existing memory. Nothing is allocated or copied.
+	// The memory must remain valid and unchanged for the lifetime of this object
+	// and of every copy made from it, as copies borrow the same memory.
+	explicit ABinaryFile(ByteSpan view);
+	
+	// Copy. O(1). The copy shares the loaded data with obj.
 	ABinaryFile(const ABinaryFile& obj);
-	virtual ABinaryFile operator=(ABinaryFile obj);
+	virtual ABinaryFile& operator=(const ABinaryFile& obj);
 	
 	// Move
 	ABinaryFile(ABinaryFile&& ref);
-	virtual ABinaryFile operator=(ABinaryFile&& obj);
+	virtual ABinaryFile& operator=(ABinaryFile&& obj);
 	
 	~ABinaryFile();
 	//------------------
@@ -72,9 +203,57 @@ public:
 	/// If position+8 exceeds size, an exception will be thrown
 	uint64_t B64(uint64_t bytePos) const;
 	
+	// Bulk decoders. Copy count values starting at BYTE position into dest,
+	// converting from the given byte order to host order.
+	// The data does not need to be aligned. Byte swapping is vectorised.
+	// If bytePos + count * sizeof(value) exceeds size, an exception will be thrown.
+	// The range is checked once, not per value.
+	void Decode(uint64_t bytePos, uint64_t count, uint16_t* dest, ByteOrder::Endian order) const;
+	void Decode(uint64_t bytePos, uint64_t count, int16_t* dest, ByteOrder::Endian order) const;
+	void Decode(uint64_t bytePos, uint64_t count, uint32_t* dest, ByteOrder::Endian order) const;
+	void Decode(uint64_t bytePos, uint64_t count, int32_t* dest, ByteOrder::Endian order) const;
+	void Decode(uint64_t bytePos, uint64_t count, uint64_t* dest, ByteOrder::Endian order) const;
+	void Decode(uint64_t bytePos, uint64_t count, int64_t* dest, ByteOrder::Endian order) const;
+	void Decode(uint64_t bytePos, uint64_t count, float* dest, ByteOrder::Endian order) const;
+	void Decode(uint64_t bytePos, uint64_t count, double* dest, ByteOrder::Endian order) const;
+	
+	// As Decode() but returns a new array.
+	// T must be one of the types Decode() accepts.
+	template<class T> std::vector<T> DecodeArray(uint64_t bytePos, uint64_t count, ByteOrder::Endian order) const {
+		std::vector<T> values(count);
+		Decode(bytePos, count, values.data(), order);
+		return values;
+	};
+	
 	// Pointer to loaded data.
 	virtual const void* Blob() const;
 	
+	// True if the data is mmap'ed rather than malloc'ed.
+	bool IsMapped() const;
+	
+	// True if the data is borrowed from the caller. See ABinaryFile(ByteSpan).
+	bool IsBorrowed() const;
+	
+	// Change the madvise() hint for mapped data. Does nothing if not mapped.
+	void Advise(AccessHint hint) const;
+	
+	// Statistics for the load that produced this data.
+	// All zero if the data did not come from a file.
+	LoadStats LoadInfo() const;
+	
+	// Byte pattern search. See ByteSearch.hpp.
+	// Positions are byte positions in the data. Searching starts at from.
+	// An empty pattern is never found. Matches can overlap.
+	// Returns -1 if not found.
+	int64_t Find(const void* pattern, uint64_t len, uint64_t from = 0) const;
+	int64_t Find(const std::string& pattern, uint64_t from = 0) const;
+	std::vector<uint64_t> FindAll(const void* pattern, uint64_t len, uint64_t from = 0) const;
+	std::vector<uint64_t> FindAll(const std::string& pattern, uint64_t from = 0) const;
+	uint64_t Count(const void* pattern, uint64_t len) const;
+	uint64_t Count(const std::string& pattern) const;
+	// Every pattern in one pass.
+	std::vector<ByteSearch::Match> FindAll(ByteSearch::MultiPattern& patterns) const;
+	
 	//----------------------------------------
 	// Also used by ABigBinaryFile
 	struct ABinaryFileEx : std::exception {
@@ -96,16 +275,39 @@ public:
 //------------------------------------------------
 #pragma mark -
 
+// Log2 histogram of durations. Bucket n counts durations of 2^n to 2^(n+1) - 1
+// nanoseconds. Bucket 0 also holds 0, and the last bucket everything longer.
+struct LatencyHistogram {
+	static const unsigned bucketCount = 32;
+	uint64_t buckets[bucketCount];
+	
+	LatencyHistogram() { Clear(); }
+	
+	static unsigned Bucket(uint64_t ns);
+	void Add(uint64_t ns) { buckets[Bucket(ns)]++; }
+	void Clear();
+	
+	uint64_t Count() const;
+	// Upper bound, in nanoseconds, of the bucket holding the fraction f (0 - 1) of
+	// durations. 0 if empty. Percentile(0.99) is the p99 to within a factor of 2.
+	uint64_t Percentile(double f) const;
+};
+
+// Counters behind ABigBinaryFile::Stats(). Defined in ABinaryFile.cpp.
+struct ABigBinaryFileCounters;
+
 /*
  Class to access very big files.
  The class loads a maximum of N blocks which are of size blockSize.
- The blockSize range is 256 - 65535.
+ The blockSize range is 256 bytes to 4GB. Blocks of 1 - 8MB suit long sequential reads.
  Max block count range is 1 to UINT_MAX, though a small number is detrimental to performance.
  A very large number will result in the system throwing a fit.
- The constructors allocate a memory block whose size = maxBlock x blockSize.
- This is stored in blockArray.
+ The blocks are kept in an ABlockCache. BlockCache.hpp describes how it is locked, read
+ ahead, shared, mapped and loaded asynchronously.
 
  The file is opened during construction, if it fails and exception will be thrown.
+ Blocks are read with pread(), so the file position is never used.
+ A descriptor passed in is never closed. Copies share it.
  
  If the file becomes inaccessible or it is closed behind the class's back, an exception will be thrown.
 */
@@ -114,71 +316,177 @@ class ABigBinaryFile {
 	// File data size
 	uint64_t dataSize;
 	
+public:
+	// single: one thread at a time. concurrent: any number of readers. See BlockCache.hpp.
+	enum class ThreadMode { single, concurrent };
+	typedef ABlockCache::Policy EvictionPolicy;
+private:
 	// Either-Or
 	int fileDesc;
 	std::string path;
-	// Remains open until destructor is called.
-	FILE* file;
+	// Descriptor blocks are read from. fileDesc, or opened from path and closed
+	// by the destructor.
+	int readDesc;
+	// Descriptor block loads use after SetDirectIO(true), or -1. Opened from path, and
+	// closed by CloseFile().
+	int directDesc;
+	int LoadDesc() const { return directDesc >= 0 ? directDesc : readDesc; }
+	// Descriptor Flush() writes to, or -1 if not writable. fileDesc, or opened from path
+	// and closed by CloseFile().
+	int writeDesc;
+	
+	// Blocks written to and not yet flushed, and their pinned slots.
+	std::map<uint64_t, uint8_t*> dirtyBlocks;
+	// How many of them are in each shard. Empty until the first Write().
+	std::vector<uint64_t> shardDirty;
+	// Flush(), ignoring errors, and unpin what is left. Before the cache goes.
+	void DropWrites();
+	// Blocks are windows mapped from the file. See SetMapped().
+	bool mapped;
 	
 	// Nunber of bytes per block. Minimum is 256.
-	uint16_t blockSize;
+	uint32_t blockSize;
 	// Number of blocks = dataSize / blockSize, rounded up.
 	int64_t blockCount;
 	
 	// Usually user set. Cannot be zero or >= blockCount
 	uint64_t maxBlocks;
 	
-	// size = maxBlocks.
-	// Array of calloc'ed pointers.
-	// blockArray pointer is only created in the constructors
-	// and deleted in the destructor.
-	char* *blockArray;
-	
-	// key is blockNumber, value is blockArray index
-	std::map<int64_t, uint64_t> blockNumAddrMap;
-	
-	// oldest in front
-	std::vector<uint64_t> blkNumberHistory;
-	
-	// Could use boost dynamic bit set
-	std::vector<bool> freeSections;
-	
-	// Does nothing in this implementation as the block is
-	// is one large memory allocation.
-	void BlockErase();
-	
-	// Zero block
-	void ZeroSection(uint64_t section);
+	ThreadMode threadMode;
+	EvictionPolicy policy;
+	// Process wide unique. Keys the per-thread last block entries.
+	uint64_t instanceID;
+	
+	// Loaded blocks, maxBlocks of them at most. The policy picks which to evict.
+	// Block n lives in shard (n + shardSalt) % shardCount. Single threaded mode has one
+	// shard and never locks.
+	// Either ownShards, created in the constructors and not shared by copies, or those
+	// of sharedCache.
+	typedef ABlockCacheShard CacheShard;
+	std::unique_ptr<CacheShard[]> ownShards;
+	std::shared_ptr<ASharedBlockCache> sharedCache;
+	CacheShard* shards;
+	unsigned shardCount;
+	
+	// Number in sharedCache, 0 with a cache of its own. Block n is keyed
+	// keyBase + n in the cache. Owners are spread over the shards by shardSalt.
+	uint32_t owner;
+	uint64_t keyBase;
+	uint64_t shardSalt;
+	
+	unsigned ShardOf(uint64_t blkNum) const { return (unsigned)((blkNum + shardSalt) % shardCount); }
+	CacheShard& ShardFor(uint64_t blkNum) const { return shards[ShardOf(blkNum)]; }
+	uint64_t Key(uint64_t blkNum) const { return keyBase + blkNum; }
+	
+	// Create the shards for threadMode, policy and maxBlocks, or join sharedCache, and
+	// zero the counters.
+	void CreateCache();
+	// shardCount shards sharing maxBlocks between them. Throws ABinaryFileEx.
+	std::unique_ptr<CacheShard[]> NewShards(bool mapped) const;
+	// Leave sharedCache, if in it.
+	void ReleaseCache();
+	
+	// Created in the constructors. Copies start from zero.
+	std::unique_ptr<ABigBinaryFileCounters> counters;
+	
+	// Background block loader. Only refers to the shards, counters and descriptor, never to
+	// this object, so it carries on working if this object is moved.
+	struct Prefetcher;
+	std::unique_ptr<Prefetcher> prefetcher;
+	// Blocks to load ahead of a detected pattern. 0 is off.
+	uint64_t readahead;
+	
+	// LoadBlocksAsync() state. Like the prefetcher, never refers to this object.
+	struct AsyncLoads;
+	std::unique_ptr<AsyncLoads> asyncLoads;
+	
+	// True if the cache is used by more than one thread and must be locked.
+	bool Shared() const { return threadMode == ThreadMode::concurrent || prefetcher || asyncLoads; }
+	
+	// Does nothing if already started, if blocks are mapped, or if the thread can not
+	// be created.
+	void StartPrefetcher();
+	
+	// Queue the readahead blocks along stride after blkNum. aheadTo is the furthest
+	// block already queued for this pattern, and is updated.
+	void ReadAhead(uint64_t blkNum, int64_t stride, int64_t& aheadTo);
+	// Note this thread's move to blkNum, and read ahead once a stride repeats.
+	void WatchStride(uint64_t blkNum);
 	
 	// Zero block after it is purged/resued.
 	// Default is false.
 	bool zeroBlocks;
 	
 	void OpenFile();
+	void CloseFile();
 	
 	// Throws FileAccessEx if there is an issue accessing the underlying file.
-	void LoadBlock(uint64_t blkNum);
+	// Returns the block's data. In concurrent mode the caller must hold the shard's lock.
+	char* LoadBlock(uint64_t blkNum);
+	
+	// Call proc with the block's data, loading it if needed.
+	// The shard is locked for the call in concurrent mode.
+	template<class P> void WithBlock(uint64_t blkNum, P proc);
+	
+	// operator[] when Shared()
+	uint8_t SharedByte(uint64_t blkNum, uint32_t idx);
+	
+	// Copy len bytes from offset in a cached block. false if the block is not cached.
+	bool CopyCached(uint64_t blkNum, uint64_t offset, void* dest, uint64_t len);
 	
 	//------------------
 	struct	timespec lastCheck;
 	
 	void DataReset();
+	// Drop what an append to a file oldSize bytes long made out of date.
+	void DataAppended(uint64_t oldSize);
+	
+	// See SetFollow().
+	bool follow;
+	
+	// See SetWatched(). Both nullptr if not watched.
+	std::shared_ptr<AFileWatcher> watcher;
+	std::shared_ptr<AFileWatcher::Watch> watch;
+	void Unwatch();
+public:
+	// What the last FileCheck() found.
+	// appended is only reported in follow mode. The blocks loaded are kept.
+	// replaced means every loaded block was dropped.
+	enum class FileChange { none, appended, replaced };
+private:
+	FileChange lastChange;
+	
+	// Pass the data from position from to proc a block at a time, via CopyToBlob(),
+	// so the cache is not changed. The last keep bytes of each window are put in front
+	// of the next so anything up to keep + 1 bytes long is seen whole in some window.
+	// proc gets (window, window length, file position of window[0]) and returns
+	// false to stop.
+	void ScanBlocks(uint64_t from, uint64_t keep, const std::function<bool(const uint8_t*, uint64_t, uint64_t)>& proc);
 public:
 	// Non-sensical
 	ABigBinaryFile() = delete;
 	
 	// Throws ABinaryFileEx
-	ABigBinaryFile(int desc, uint16_t blockSz, uint64_t maxBlks);
+	// desc is not closed, and must stay open for the life of this object and its copies.
+	ABigBinaryFile(int desc, uint32_t blockSz, uint64_t maxBlks, ThreadMode mode = ThreadMode::single,
+				   EvictionPolicy policy = EvictionPolicy::lru);
+	
+	// Throws ABinaryFileEx
+	ABigBinaryFile(const std::string& path, uint32_t blockSz, uint64_t maxBlks, ThreadMode mode = ThreadMode::single,
+				   EvictionPolicy policy = EvictionPolicy::lru);
 	
 	// Throws ABinaryFileEx
-	ABigBinaryFile(const std::string& path, uint16_t blockSz, uint64_t maxBlks);
+	// Blocks are kept in cache, shared with other instances, with its block size and
+	// policy. Thread safe as ThreadMode::concurrent. Copies join the same cache.
+	ABigBinaryFile(int desc, std::shared_ptr<ASharedBlockCache> cache);
+	ABigBinaryFile(const std::string& path, std::shared_ptr<ASharedBlockCache> cache);
 	
-	// The copy constructor will not copy loaded blocks, block history or freeSections.
-	// The FILE* property will not be copied. A new one will be opened.
+	// The copy constructor will not copy loaded blocks.
+	// A path based copy opens the file again. A descriptor based copy shares the descriptor.
 	// Using a copy constructor or assignment operator can be expensive in time and
 	// memory.
 	ABigBinaryFile(const ABigBinaryFile& obj);
-	ABigBinaryFile operator=(const ABigBinaryFile& obj);
+	ABigBinaryFile& operator=(const ABigBinaryFile& obj);
 	
 	// Move constructors
 	ABigBinaryFile(ABigBinaryFile&& ref);
@@ -192,44 +500,354 @@ public:
 	// This can throw FileAccessEx as it may call through to LoadBlock()
 	uint8_t operator[](uint64_t pos);
 private:
-	// Last accessed block. Saves looking up blockNumAddrMap dictionary all the time.
+	// Last accessed block. Saves looking up the cache all the time.
+	// Single threaded mode only. Concurrent mode keeps one per thread.
 	char* currentPtr;
 	// If < 0, no last block
 	int64_t currBlockNum;
 public:
 	// Do not zero blocks when loading new data.
-	void SkipZeroing(bool yes) { zeroBlocks = yes; }
+	void SkipZeroing(bool yes);
+	
+	ThreadMode Threading() const { return threadMode; }
+	EvictionPolicy Eviction() const { return policy; }
+	// nullptr if the cache is this object's own.
+	std::shared_ptr<ASharedBlockCache> SharedCache() const { return sharedCache; }
+	
+	// Load blocks with O_DIRECT (F_NOCACHE on macOS), so they are not held twice. Reads
+	// that bypass the cache still use the page cache. Only for path based files whose block size is a multiple of ABlockCache::PageSize().
+	// Returns false, changing nothing, if not so or if the file system does not allow it.
+	// Not thread safe.
+	bool SetDirectIO(bool yes);
+	bool DirectIO() const { return directDesc >= 0; }
+	
+	// Map each block's window of the file into its slot instead of reading a copy.
+	// Only for files with a cache of their own, used by one thread (no concurrent mode,
+	// readahead thread or LoadBlocksAsync()), not using direct IO, whose block size is a
+	// multiple of ABlockCache::PageSize(), with no block pinned. Returns false, changing
+	// nothing, if not so. Drops the loaded blocks and restarts Stats(). Not thread safe.
+	bool SetMapped(bool yes);
+	bool Mapped() const { return mapped; }
+	
+	// Allow Write(). Path based files are opened again for writing.
+	// A descriptor must have been opened for writing. Returns false if the file can not
+	// be written, or blocks are mapped. Turning it off calls Flush().
+	// Not thread safe.
+	bool SetWritable(bool yes);
+	bool Writable() const { return writeDesc >= 0; }
+	
+	// Copy len bytes from data over the file from position pos, in the cache. The file
+	// is never extended, so pos + len can not pass Size().
+	// Throws ABinaryFileEx if not writable or out of range, and FileAccessEx if a block
+	// can not be loaded or an automatic Flush() fails. Changed blocks stay pinned until
+	// flushed, at most half of each shard's slots. Not thread safe, with anything.
+	void Write(uint64_t pos, const void* data, uint64_t len);
+	
+	// Write every written block back to the file. sync then calls fdatasync() once.
+	// Reset(), file changes, the destructor and assignment flush too, the last two
+	// ignoring errors. If the file changed since the last FileCheck(), the next one still
+	// sees it.
+	// Throws FileAccessEx if a write fails, leaving the blocks not written dirty.
+	// Not thread safe.
+	void Flush(bool sync = false);
+	// Blocks written to since the last Flush().
+	uint64_t DirtyBlocks() const { return dirtyBlocks.size(); }
 	
 	// Returns size of file data
 	uint64_t Size() const;
 	
 	// Block Size
-	uint16_t BlockSize() const;
+	uint32_t BlockSize() const;
 	
 	// Number of bytes for the last block of a file.
 	// This is most likely not the block size.
 	// blockCount * blockSize does not necessarily equal file size.
-	// = dataSize % blockSize
-	uint16_t LastBlockSize() const;
+	// = dataSize % blockSize, or blockSize if that is zero. Zero for an empty file.
+	uint32_t LastBlockSize() const;
 	
 	// Number of blocks. This can be zero.
 	uint64_t BlockCount() const;
 	
-	//
+	// True if the block is in the cache.
 	bool BlockIsLoaded(uint64_t blockNumber) const;
 	
-	// List of currently loaded blocks
+	// List of currently loaded blocks, next to be evicted first.
 	std::vector<uint64_t> LoadedBlocks() const;
 	
+	// Counters since construction or ResetStats(), for choosing maxBlocks, the policy
+	// and the readahead. hits, misses, evictions and prefetchUsed are the whole cache's
+	// for a shared cache.
+	struct CacheStats {
+		// Block lookups that found the block, and that did not.
+		uint64_t hits;
+		uint64_t misses;
+		// Blocks evicted to make room for others.
+		uint64_t evictions;
+		// Blocks loaded by the prefetcher, and how many of those were then read.
+		uint64_t prefetched;
+		uint64_t prefetchUsed;
+		// pread()/preadv() calls made, by every path, and the bytes they read.
+		uint64_t reads;
+		uint64_t bytesRead;
+		// pwritev() calls made by Flush(), and the bytes they wrote.
+		uint64_t writes;
+		uint64_t bytesWritten;
+		// Time to load a block on a miss. Not prefetcher loads.
+		LatencyHistogram loadLatency;
+		
+		// hits / lookups. 0 if there have been none.
+		double HitRatio() const;
+		// prefetchUsed / prefetched. 0 if nothing was prefetched.
+		double PrefetchUsefulness() const;
+	};
+	
+	// A snapshot. Thread safe, but the counters are not read at one instant.
+	CacheStats Stats() const;
+	// Thread safe.
+	void ResetStats();
+	
+	double HitRatio() const { return Stats().HitRatio(); }
+	
+	// Copy len bytes from file position pos to dest. They can span any number of blocks.
+	// Blocks in the cache are copied from it. Each run of blocks that are not is read
+	// with one pread() straight into dest, without going through the cache.
+	// Returns the bytes copied, which is less than len if the range passes the end of
+	// the file. Throws ABinaryFileEx if pos > Size(), FileAccessEx if reading fails.
+	uint64_t Read(uint64_t pos, void* dest, uint64_t len);
+	
+	// One range for ReadV().
+	struct Extent {
+		uint64_t pos;
+		void* dest;
+		uint64_t len;
+	};
+	
+	// Read() for many ranges at once. Ranges are clipped to the end of the file.
+	// Missing data for ranges that follow each other in the file is read with a single
+	// preadv(), whatever order the ranges are given in.
+	// Returns the total bytes copied. Throws as Read().
+	uint64_t ReadV(const std::vector<Extent>& extents);
+	
+	class ByteIterator;
+	
+	// Keeps a block in the cache, and its data at a fixed address, for as long as it
+	// exists. Move only. Must not outlive the ABigBinaryFile that made it.
+	// Pinned blocks are never evicted. If every block is pinned, loading another throws.
+	// Reset() or a file change drops a pinned block from the cache, but the handle's
+	// data stays as it was until the handle goes.
+	class PinnedBlock {
+		std::atomic<uint32_t>* pin;
+		const uint8_t* data;
+		uint64_t size;
+		uint64_t block;
+		uint64_t position;
+	public:
+		PinnedBlock() : pin(nullptr), data(nullptr), size(0), block(0), position(0) {}
+		PinnedBlock(std::atomic<uint32_t>* pin, const uint8_t* data, uint64_t size, uint64_t block, uint64_t position)
+				: pin(pin), data(data), size(size), block(block), position(position) {}
+		PinnedBlock(const PinnedBlock&) = delete;
+		PinnedBlock& operator=(const PinnedBlock&) = delete;
+		PinnedBlock(PinnedBlock&& ref) : PinnedBlock() { Swap(ref); }
+		PinnedBlock& operator=(PinnedBlock&& ref) { Release(); Swap(ref); return *this; }
+		~PinnedBlock() { Release(); }
+		
+		// Unpin now. The handle becomes empty.
+		void Release() {
+			if (pin) { pin->fetch_sub(1, std::memory_order_release); }
+			pin = nullptr;
+			data = nullptr;
+			size = 0;
+		};
+		
+		bool Valid() const { return data != nullptr; }
+		const uint8_t* Data() const { return data; }
+		// Bytes of file data. Less than the block size for the last block.
+		uint64_t Size() const { return size; }
+		ByteSpan Bytes() const { return ByteSpan(data, size); }
+		uint64_t Block() const { return block; }
+		// File position of Data()[0].
+		uint64_t Position() const { return position; }
+		// No bounds check.
+		uint8_t operator[](uint64_t idx) const { return data[idx]; }
+	private:
+		// Keeps the pin without a handle.
+		friend class ABigBinaryFile::ByteIterator;
+		
+		void Swap(PinnedBlock& B) {
+			std::swap(pin, B.pin);
+			std::swap(data, B.data);
+			std::swap(size, B.size);
+			std::swap(block, B.block);
+			std::swap(position, B.position);
+		};
+	};
+	
+	// Load and pin a block. Throws ABinaryFileEx if blockNumber >= blockCount or
+	// every block is already pinned, and FileAccessEx if it can not be read.
+	PinnedBlock Pin(uint64_t blockNumber);
+	
+	// Random access iterator over the file's bytes, for <algorithm>. Each live iterator
+	// can pin a block, so maxBlocks must be more than the iterators in use.
+	// Moving it only changes its position. Reading a byte outside the block it holds
+	// pins that block, with Pin(), and unpins the last. Copies share the pin.
+	// Reading outside the file throws ABinaryFileEx. Must not outlive the ABigBinaryFile.
+	class ByteIterator {
+	public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef uint8_t value_type;
+		typedef int64_t difference_type;
+		typedef const uint8_t* pointer;
+		// By value. A byte's address changes once the iterator leaves its block.
+		typedef uint8_t reference;
+	private:
+		ABigBinaryFile* file;
+		uint64_t pos;
+		// Pinned block holding file bytes [start, end), or nullptr.
+		mutable std::atomic<uint32_t>* pin;
+		mutable const uint8_t* data;
+		mutable uint64_t start;
+		mutable uint64_t end;
+		
+		// Pin the block holding pos and return its byte.
+		uint8_t Load() const;
+		void Release() const {
+			if (pin) { pin->fetch_sub(1, std::memory_order_release); }
+			pin = nullptr;
+			start = end = 0;
+		};
+		void Share(const ByteIterator& I) {
+			pin = I.pin;
+			data = I.data;
+			start = I.start;
+			end = I.end;
+			// Already pinned, so no lock is needed.
+			if (pin) { pin->fetch_add(1, std::memory_order_relaxed); }
+		};
+	public:
+		ByteIterator() : file(nullptr), pos(0), pin(nullptr), data(nullptr), start(0), end(0) {}
+		ByteIterator(ABigBinaryFile* file, uint64_t pos) : file(file), pos(pos), pin(nullptr), data(nullptr), start(0), end(0) {}
+		ByteIterator(const ByteIterator& I) : file(I.file), pos(I.pos) { Share(I); }
+		ByteIterator& operator=(const ByteIterator& I) {
+			if (this != &I) {
+				Release();
+				file = I.file;
+				pos = I.pos;
+				Share(I);
+			}
+			return *this;
+		};
+		~ByteIterator() { Release(); }
+		
+		// File position.
+		uint64_t Position() const { return pos; }
+		
+		uint8_t operator*() const { return pos - start < end - start ? data[pos - start] : Load(); }
+		uint8_t operator[](difference_type n) const { return *(*this + n); }
+		
+		ByteIterator& operator++() { pos++; return *this; }
+		ByteIterator operator++(int) { ByteIterator I(*this); pos++; return I; }
+		ByteIterator& operator--() { pos--; return *this; }
+		ByteIterator operator--(int) { ByteIterator I(*this); pos--; return I; }
+		ByteIterator& operator+=(difference_type n) { pos += n; return *this; }
+		ByteIterator& operator-=(difference_type n) { pos -= n; return *this; }
+		ByteIterator operator+(difference_type n) const { ByteIterator I(*this); I.pos += n; return I; }
+		ByteIterator operator-(difference_type n) const { ByteIterator I(*this); I.pos -= n; return I; }
+		friend ByteIterator operator+(difference_type n, const ByteIterator& I) { return I + n; }
+		difference_type operator-(const ByteIterator& I) const { return (difference_type)(pos - I.pos); }
+		
+		bool operator==(const ByteIterator& I) const { return pos == I.pos; }
+		bool operator!=(const ByteIterator& I) const { return pos != I.pos; }
+		bool operator<(const ByteIterator& I) const { return pos < I.pos; }
+		bool operator>(const ByteIterator& I) const { return pos > I.pos; }
+		bool operator<=(const ByteIterator& I) const { return pos <= I.pos; }
+		bool operator>=(const ByteIterator& I) const { return pos >= I.pos; }
+	};
+	typedef ByteIterator iterator;
+	typedef ByteIterator const_iterator;
+	
+	ByteIterator begin() { return ByteIterator(this, 0); }
+	ByteIterator end() { return ByteIterator(this, dataSize); }
+	
+	// Iterator over whole blocks, from Blocks(). Gives (block number, file data in
+	// the block). The block is pinned while the iterator is on it, so the span stays
+	// good until the iterator moves. Copies pin the block again when read.
+	class BlockIterator {
+	public:
+		typedef std::input_iterator_tag iterator_category;
+		typedef std::pair<uint64_t, ByteSpan> value_type;
+		typedef int64_t difference_type;
+		typedef const value_type* pointer;
+		typedef value_type reference;
+	private:
+		ABigBinaryFile* file;
+		uint64_t blk;
+		mutable PinnedBlock block;
+	public:
+		BlockIterator(ABigBinaryFile* file, uint64_t blk) : file(file), blk(blk) {}
+		BlockIterator(const BlockIterator& I) : file(I.file), blk(I.blk) {}
+		BlockIterator& operator=(const BlockIterator& I) {
+			file = I.file;
+			blk = I.blk;
+			block.Release();
+			return *this;
+		};
+		
+		value_type operator*() const {
+			if (!block.Valid()) { block = file->Pin(blk); }
+			return value_type(blk, block.Bytes());
+		};
+		BlockIterator& operator++() { block.Release(); blk++; return *this; }
+		BlockIterator operator++(int) { BlockIterator I(*this); ++*this; return I; }
+		
+		bool operator==(const BlockIterator& I) const { return blk == I.blk; }
+		bool operator!=(const BlockIterator& I) const { return blk != I.blk; }
+	};
+	
+	class BlockRange {
+		ABigBinaryFile* file;
+		uint64_t first;
+		uint64_t last;
+	public:
+		BlockRange(ABigBinaryFile* file, uint64_t first, uint64_t last) : file(file), first(first), last(last) {}
+		BlockIterator begin() const { return BlockIterator(file, first); }
+		BlockIterator end() const { return BlockIterator(file, last); }
+	};
+	
+	// Blocks from first to the end of the file, in order. For range based for.
+	BlockRange Blocks(uint64_t first = 0) { return BlockRange(this, std::min<uint64_t>(first, blockCount), blockCount); }
+	
 	// Preload a block. If blockNumber >= blockCount, nothing will happen.
 	// But FileAccessEx can be thrown as this calls through to LoadBlock()
 	void Preload(uint64_t blockNumber);
 	
+	// Number of blocks to load in the background ahead of a reader moving with a steady
+	// stride. Limited to half of maxBlocks. 0 turns readahead off and stops the thread.
+	void SetReadahead(uint64_t blocks);
+	uint64_t Readahead() const { return readahead; }
+	
+	// Queue the blocks holding len bytes from start for loading in the background and
+	// return at once. Starts the background thread if needed. Blocks past what the
+	// cache can hold are not queued. Read errors are ignored. They will happen again
+	// when the block is read.
+	void PrefetchRange(uint64_t start, uint64_t len);
+	
+	// Load blocks into the cache without waiting. Returns once the reads are queued.
+	// done(blockNumber, ok) is called once per block, on a loader thread, or on this one
+	// for blocks already loaded. ok is false if the block could not be read, is out of
+	// range, every block is pinned or Reset() dropped it while it was read. At most half
+	// of a shard's slots are read into at once. Blocks past that also get false.
+	// done must not call WaitAsync(), Reset(), FileCheck() or SetDirectIO().
+	// Throws ABinaryFileEx if the loader threads can not be started.
+	void LoadBlocksAsync(const std::vector<uint64_t>& blockNumbers, std::function<void(uint64_t blockNumber, bool ok)> done);
+	
+	// Until every LoadBlocksAsync() read has finished and been reported.
+	void WaitAsync();
+	
 	// If any parameter is invalid, an exception will be thrown.
 	// If size < block size, first size bytes will be copied.
 	// Return value is number of bytes copied. This can be less than
 	// the block size if the the last block of the file is not block size bytes.
-	uint16_t CopyToBlob(void* dest, uint16_t size, uint64_t blockNumber) const;
+	uint32_t CopyToBlob(void* dest, uint32_t size, uint64_t blockNumber) const;
 	
 	// If blockNumber is >= block count, an exception will be thrown.
 	// Pointer returned is always blockSize bytes.
@@ -239,7 +857,7 @@ public:
 	void* CopyBlock_F(uint64_t blockNumber);
 	
 	// A pointer to the blob is not returned because the data pointed to
-	// can arbitarily change.
+	// can arbitarily change. Use Pin() for a pointer that stays put.
 	
 	// Attempt to copy all file data to memory.
 	// It is all or nothing. Caller must call free()
@@ -253,12 +871,39 @@ public:
 	// This will clear internal data if changes are detected.
 	// A ABinaryFileEx exception will be thrown if there is any issues with the underlying file.
 	// If it has been modified, all internal data will be cleared.
+	// In follow mode, growth is an append instead.
 	void FileCheck();
+	FileChange LastChange() const { return lastChange; }
+	
+	// Have AFileWatcher::Global() flag changes to the file, so FileCheckIfChanged() is
+	// cheap. Returns false if the file can not be watched.
+	bool SetWatched(bool yes);
+	bool Watched() const { return watch != nullptr; }
+	
+	// FileCheck(), if the watcher has seen a change since the last call, or the file is
+	// not watched. Else only one atomic flag is read. Returns true if FileCheck() was called.
+	bool FileCheckIfChanged();
+	
+	// Follow mode, for files that are only ever appended to, such as logs. Off by default.
+	// Growth only drops the old last block. Shrinking or rewriting still resets.
+	void SetFollow(bool yes) { follow = yes; }
+	bool Following() const { return follow; }
+	
+	// Byte pattern search, as ABinaryFile.
+	// Matches spanning blocks are found. Blocks in the cache are used as they are,
+	// others are read straight from the file without being added to the cache.
+	// Can throw the exceptions CopyToBlob() throws.
+	int64_t Find(const void* pattern, uint64_t len, uint64_t from = 0);
+	int64_t Find(const std::string& pattern, uint64_t from = 0);
+	std::vector<uint64_t> FindAll(const void* pattern, uint64_t len, uint64_t from = 0);
+	std::vector<uint64_t> FindAll(const std::string& pattern, uint64_t from = 0);
+	uint64_t Count(const void* pattern, uint64_t len);
+	uint64_t Count(const std::string& pattern);
+	std::vector<ByteSearch::Match> FindAll(ByteSearch::MultiPattern& patterns);
 	
 	/*
 	Future
 	------
-	LockBlock() - prevent a block from being purged.
 	operator[] with signed integer. If -ve, the byte is read from the end of the data block.
 	*/
 	
@@ -8,11 +8,15 @@
 
 #include "ATextFile.hpp"
 #include "Debug.hpp"
+#include "ByteSearch.hpp"
+#include <chrono>
+#include <algorithm>
 
 ATextFile::ATextFile() {
 	DebugPretty
 	
 	textLF = NewLine::unix;
+	lines = std::make_shared<SST::StringArray>();
 };
 
 ATextFile::ATextFile(int desc, NewLine lf) : ABinaryFile(desc) {
@@ -36,6 +40,13 @@ ATextFile::ATextFile(void* memoryBlock, uint64_t memSize, NewLine lf) : ABinaryF
 	RetrieveLines();
 };
 
+ATextFile::ATextFile(ByteSpan view, NewLine lf) : ABinaryFile(view) {
+	DebugPretty
+	
+	textLF = lf;
+	RetrieveLines();
+};
+
 ATextFile::ATextFile(const ATextFile& obj) : ABinaryFile(obj) {
 	DebugPretty
 	
@@ -43,7 +54,7 @@ ATextFile::ATextFile(const ATextFile& obj) : ABinaryFile(obj) {
 	lines = obj.lines;
 };
 
-ATextFile ATextFile::operator=(const ATextFile& obj) {
+ATextFile& ATextFile::operator=(const ATextFile& obj) {
 	DebugPretty
 	
 	ABinaryFile::operator=(obj);
@@ -57,13 +68,14 @@ ATextFile::ATextFile(ATextFile&& ref) : ABinaryFile(std::move(ref)) {
 	DebugPretty
 	
 	textLF = ref.textLF;
+	lines = std::make_shared<SST::StringArray>();
 	std::swap(lines, ref.lines);
 };
 
-ATextFile ATextFile::operator=(ATextFile&& ref) {
+ATextFile& ATextFile::operator=(ATextFile&& ref) {
 	DebugPretty
 	
-	ABinaryFile::operator=(static_cast<const ABinaryFile&&>(std::move(ref)) );
+	ABinaryFile::operator=(std::move(static_cast<ABinaryFile&>(ref)));
 	textLF = ref.textLF;
 	std::swap(lines, ref.lines);
 	
@@ -77,57 +89,43 @@ void ATextFile::Refresh() {
 //----------------------------
 #pragma mark -
 
-bool ATextFile::IsLineFeed(uint64_t& idx) {
-	char c = ABinaryFile::operator[](idx);
+void ATextFile::RetrieveLines() {
+	DebugPretty
+	
+	const char* text = Size() > 0 ? (const char*)Blob() : "";
+	uint64_t len = Size();
+	std::vector<uint64_t> feeds;
 	switch (textLF) {
 		case NewLine::classicMac:
-			return c == 13;
+			ByteSearch::FindAllByte(text, len, 13, feeds);
 			break;
 		case NewLine::unix:
-			return c == 10;
+			ByteSearch::FindAllByte(text, len, 10, feeds);
 			break;
-		case NewLine::windows:
-			if (c != 13) { return false;}
-			if (idx == Size() - 1) { return false; }
-			char c = ABinaryFile::operator[](idx + 1);
-			// If this position is a new line, we need to increment the index by one
-			// otherwise RetrieveLines() will assume the LF character is
-			// part of the text file.
-			if (c == 10) {
-				idx++;
-				return true;
-			}
-			return false;
+		case NewLine::windows: {
+			bool cr = false;
+			ByteSearch::FindAllCRLF(text, len, feeds, 0, cr);
 			break;
+		}
 	};
-};
-
-void ATextFile::RetrieveLines() {
-	DebugPretty
 	
-	lines.clear();
-	std::string s;
-	char c;
-	bool lastNotLF = true;
-	for (uint64_t idx = 0; idx < Size(); idx++) {
-		c = ABinaryFile::operator[](idx);
-		if (IsLineFeed(idx)) {
-			lines.push_back(s);
-			lastNotLF = false;
-			s = "";
-		}
-		else {
-			s.append(&c, 1);
-			lastNotLF = true;
-		}
+	uint64_t lfLen = textLF == NewLine::windows ? 2 : 1;
+	std::shared_ptr<SST::StringArray> found = std::make_shared<SST::StringArray>();
+	found->reserve(feeds.size() + 1);
+	uint64_t start = 0;
+	for (uint64_t at : feeds) {
+		found->push_back(std::string(text + start, at - start));
+		start = at + lfLen;
 	}
-	if (lastNotLF) {
-		lines.push_back(s);
+	// Text after the last line feed. An empty file is one empty line.
+	if (start < len || feeds.empty()) {
+		found->push_back(std::string(text + start, len - start));
 	}
+	lines = found;
 };
 
 uint64_t ATextFile::LineCount() const {
-	return lines.size();
+	return lines->size();
 };
 
 std::string ATextFile::operator[](uint64_t line) const {
@@ -136,7 +134,7 @@ std::string ATextFile::operator[](uint64_t line) const {
 #endif
 	
 	if (line >= LineCount()) { throw ATFException("Out of range"); }
-	return lines[line];
+	return (*lines)[line];
 };
 
 SST::StringArray ATextFile::AllLines() const {
@@ -144,18 +142,18 @@ SST::StringArray ATextFile::AllLines() const {
 	DebugPretty
 #endif
 	
-	return lines;
+	return *lines;
 };
 
 char* ATextFile::CString_F(uint64_t line) const {
 	DebugPretty
 	
 	if (line >= LineCount()) { return nullptr; }
-	size_t len = lines[line].size();
+	size_t len = (*lines)[line].size();
 	char* ptr = (char*)malloc(len + 1);
 	if (ptr) {
 		bzero(ptr, len + 1);
-		memcpy(ptr, lines[line].c_str(), len);
+		memcpy(ptr, (*lines)[line].c_str(), len);
 	}
 	return ptr;
 };
@@ -172,7 +170,7 @@ ABigTextFile::ABigTextFile() {
 };
 */
 
-ABigTextFile::ABigTextFile(int desc, uint16_t blockSz, uint64_t maxBlks, uint16_t maxLines, ATextFile::NewLine lf)
+ABigTextFile::ABigTextFile(int desc, uint32_t blockSz, uint64_t maxBlks, uint16_t maxLines, ATextFile::NewLine lf)
 		: ABigBinaryFile(desc, blockSz, maxBlks) {
 	DebugPretty
 	
@@ -180,11 +178,12 @@ ABigTextFile::ABigTextFile(int desc, uint16_t blockSz, uint64_t maxBlks, uint16_
 	lastIsLF = false;
 	maxLinesHeld = maxLines;
 	doNotUpdate = false;
+	lineStats = LineStats();
 	
 	RetrieveLinePositions();
 };
 
-ABigTextFile::ABigTextFile(const std::string& path, uint16_t blockSz, uint64_t maxBlks, uint16_t maxLines, ATextFile::NewLine lf)
+ABigTextFile::ABigTextFile(const std::string& path, uint32_t blockSz, uint64_t maxBlks, uint16_t maxLines, ATextFile::NewLine lf)
  		: ABigBinaryFile(path, blockSz, maxBlks) {
 	DebugPretty
 	
@@ -192,6 +191,33 @@ ABigTextFile::ABigTextFile(const std::string& path, uint16_t blockSz, uint64_t m
 	lastIsLF = false;
 	maxLinesHeld = maxLines;
 	doNotUpdate = false;
+	lineStats = LineStats();
+	
+	RetrieveLinePositions();
+};
+
+ABigTextFile::ABigTextFile(int desc, std::shared_ptr<ASharedBlockCache> cache, uint16_t maxLines, ATextFile::NewLine lf)
+		: ABigBinaryFile(desc, cache) {
+	DebugPretty
+	
+	textLF = lf;
+	lastIsLF = false;
+	maxLinesHeld = maxLines;
+	doNotUpdate = false;
+	lineStats = LineStats();
+	
+	RetrieveLinePositions();
+};
+
+ABigTextFile::ABigTextFile(const std::string& path, std::shared_ptr<ASharedBlockCache> cache, uint16_t maxLines, ATextFile::NewLine lf)
+		: ABigBinaryFile(path, cache) {
+	DebugPretty
+	
+	textLF = lf;
+	lastIsLF = false;
+	maxLinesHeld = maxLines;
+	doNotUpdate = false;
+	lineStats = LineStats();
 	
 	RetrieveLinePositions();
 };
@@ -209,11 +235,13 @@ ABigTextFile::ABigTextFile(const ABigTextFile& obj) : ABigBinaryFile(obj) {
 //	lineHistory = obj.lineHistory;
 	maxLinesHeld = obj.maxLinesHeld;
 	doNotUpdate = false;
+	lineStats = LineStats();
+	appended = obj.appended;
 	
 	RetrieveLinePositions();
 };
 
-ABigTextFile ABigTextFile::operator=(const ABigTextFile& obj) {
+ABigTextFile& ABigTextFile::operator=(const ABigTextFile& obj) {
 	DebugPretty
 	
 	ABigBinaryFile::operator=(obj);
@@ -228,6 +256,8 @@ ABigTextFile ABigTextFile::operator=(const ABigTextFile& obj) {
 //	lineHistory = obj.lineHistory;
 	maxLinesHeld = obj.maxLinesHeld;
 	doNotUpdate = false;
+	lineStats = LineStats();
+	appended = obj.appended;
 	
 	RetrieveLinePositions();
 	
@@ -237,27 +267,33 @@ ABigTextFile ABigTextFile::operator=(const ABigTextFile& obj) {
 ABigTextFile::ABigTextFile(ABigTextFile&& ref) : ABigBinaryFile(std::move(ref)) {
 	DebugPretty
 	
-	lineFeedPositions = ref.lineFeedPositions;
+	lineFeedPositions = std::move(ref.lineFeedPositions);
+	indexedSize = ref.indexedSize;
 	textLF = ref.textLF;
 	lastIsLF = ref.lastIsLF;
-	lineCache = ref.lineCache;
-	lineHistory = ref.lineHistory;
+	lineCache = std::move(ref.lineCache);
+	lineHistory = std::move(ref.lineHistory);
 	maxLinesHeld = ref.maxLinesHeld;
 	doNotUpdate = ref.doNotUpdate;
+	lineStats = ref.lineStats;
+	appended = std::move(ref.appended);
 	
 };
 
-ABigTextFile ABigTextFile::operator=(ABigTextFile&& ref) {
+ABigTextFile& ABigTextFile::operator=(ABigTextFile&& ref) {
 	DebugPretty
 	
-	ABigBinaryFile::operator=(static_cast<const ABigBinaryFile&&>(std::move(ref)) );
-	lineFeedPositions = ref.lineFeedPositions;
+	ABigBinaryFile::operator=(static_cast<ABigBinaryFile&&>(ref));
+	lineFeedPositions = std::move(ref.lineFeedPositions);
+	indexedSize = ref.indexedSize;
 	textLF = ref.textLF;
 	lastIsLF = ref.lastIsLF;
-	lineCache = ref.lineCache;
-	lineHistory = ref.lineHistory;
+	lineCache = std::move(ref.lineCache);
+	lineHistory = std::move(ref.lineHistory);
 	maxLinesHeld = ref.maxLinesHeld;
 	doNotUpdate = ref.doNotUpdate;
+	lineStats = ref.lineStats;
+	appended = std::move(ref.appended);
 	
 	return *this;
 };
@@ -267,29 +303,46 @@ void ABigTextFile::RetrieveLinePositions() {
 	
 	lastIsLF = false;
 	lineFeedPositions.clear();
+	indexedSize = 0;
+	
+	IndexLines(0);
+};
+
+void ABigTextFile::IndexLines(uint64_t from) {
+	DebugPretty
 	
 	if (Size() == 0) { return; }
-	lineFeedPositions.push_back(0);
-	
-	uint64_t pos;
-	for (pos = 0; pos < Size(); pos++) {
-		if (IsLineFeed(pos)) {
-			// For windows new line, sz will be incremented by
-			// an additional 1.
-	//		printf("Line Index %llu\n", pos);
-			lineFeedPositions.push_back(pos);
-		}
+	if (lineFeedPositions.empty()) { lineFeedPositions.push_back(0); }
+	
+	// A linear scan, so with SetReadahead() the blocks are loaded ahead of it.
+	bool cr = false;
+	uint64_t skip = from % BlockSize();
+	for (auto B : Blocks(from / BlockSize())) {
+		ByteSpan span = B.second;
+		if (span.size <= skip) { break; }
+		
+		const uint8_t* data = span.data + skip;
+		uint64_t len = span.size - skip;
+		uint64_t pos = B.first * BlockSize() + skip;
+		switch (textLF) {
+			case ATextFile::NewLine::classicMac:
+				ByteSearch::FindAllByte(data, len, 13, lineFeedPositions, pos);
+				break;
+			case ATextFile::NewLine::unix:
+				ByteSearch::FindAllByte(data, len, 10, lineFeedPositions, pos);
+				break;
+			case ATextFile::NewLine::windows:
+				// A pair can be split between blocks.
+				ByteSearch::FindAllCRLF(data, len, lineFeedPositions, pos, cr);
+				break;
+		};
+		skip = 0;
 	}
 //	printf("%lu\n", lineFeedPositions.size());
-	if (textLF == ATextFile::NewLine::windows) {
-		pos = Size() - 2;
-		lastIsLF = IsLineFeed(pos);
-	}
-	else {
-		pos = Size() - 1;
-		lastIsLF = IsLineFeed(pos);
-	}
 	
+	uint64_t lfLen = IsWindows() ? 2 : 1;
+	lastIsLF = lineFeedPositions.size() > 1 && lineFeedPositions.back() + lfLen == Size();
+	indexedSize = Size();
 };
 
 
@@ -312,38 +365,48 @@ void ABigTextFile::Refresh() {
 	RetrieveLinePositions();
 };
 
-uint64_t ABigTextFile::LineCount() const {
-	if (Size() == 0) { return 0; }
-	return lastIsLF ? lineFeedPositions.size() + 1 : lineFeedPositions.size();
+void ABigTextFile::ForgetLines(uint64_t first) {
+	DebugPretty
+	
+	lineCache.erase(lineCache.lower_bound(first), lineCache.end());
+	lineHistory.erase(std::remove_if(lineHistory.begin(), lineHistory.end(),
+			[first](uint64_t line) { return line >= first; }), lineHistory.end());
 };
 
-bool ABigTextFile::IsLineFeed(uint64_t& idx) {
-#if DebugTextDetailed == 2
+uint64_t ABigTextFile::Update() {
 	DebugPretty
-#endif
+	
+	uint64_t oldSize = indexedSize;
+	uint64_t oldLines = LineCount();
+	bool oldLastIsLF = lastIsLF;
+	
+	if (!FileCheckIfChanged()) { return LineCount(); }
+	if (LastChange() == FileChange::replaced) {
+		Refresh();
+		return 0;
+	}
+	if (LastChange() != FileChange::appended) {
+		// A plain check that saw growth has not reset the blocks the index was built
+		// from, but the index does not cover the new bytes.
+		if (Size() == oldSize) { return LineCount(); }
+		Refresh();
+		return 0;
+	}
+	
+	// An unfinished last line goes on in the new bytes.
+	uint64_t first = oldSize == 0 || oldLastIsLF ? oldLines : oldLines - 1;
+	ForgetLines(first);
+	// A CR that ended the old bytes can start a windows line feed.
+	IndexLines(IsWindows() && oldSize > 0 ? oldSize - 1 : oldSize);
+	
+	if (appended && first < LineCount()) { appended(first, LineCount()); }
+	return first;
+};
 
-	char c = ABigBinaryFile::operator[](idx);
-	switch (textLF) {
-		case ATextFile::NewLine::classicMac:
-			return c == 13;
-			break;
-		case ATextFile::NewLine::unix:
-			return c == 10;
-			break;
-		case ATextFile::NewLine::windows:
-			if (c != 13) { return false;}
-			if (idx == Size() - 1) { return false; }
-			char c = ABigBinaryFile::operator[](idx + 1);
-			// If this position is a new line, we need to increment the index by one
-			// otherwise RetrieveLinePositions() will assume the LF character is
-			// part of the text file.
-			if (c == 10) {
-				idx++;
-				return true;
-			}
-			return false;
-			break;
-	};
+uint64_t ABigTextFile::LineCount() const {
+	if (Size() == 0) { return 0; }
+	// A line feed at the very end does not start another line.
+	return lastIsLF ? lineFeedPositions.size() - 1 : lineFeedPositions.size();
 };
 
 void ABigTextFile::AddToHistory(uint64_t line, std::string& s) {
@@ -365,6 +428,7 @@ void ABigTextFile::AddToHistory(uint64_t line, std::string& s) {
 		uint64_t old = lineHistory[0];
 		lineHistory.erase(lineHistory.begin());
 		lineCache.erase(old);
+		lineStats.evictions++;
 	//	printf("-");
 	}
 	
@@ -386,24 +450,22 @@ std::string ABigTextFile::operator[](uint64_t line) {
 #if DebugTextDetailed == 2
 		printf("\tFrom cache\n");
 #endif
+		lineStats.hits++;
 		return litr->second;
 	}
+	lineStats.misses++;
+	auto start = std::chrono::steady_clock::now();
 	
-	int64_t pos = IsWindows() ? -2 : -1;
+	uint64_t actualPos = 0;
 	if (line > 0) {
-		pos = lineFeedPositions[line];
+		actualPos = lineFeedPositions[line] + (IsWindows() ? 2 : 1);
 	}
 	
-	uint64_t nextLF = 0;
-	if (line == LineCount() - 1) {
-		nextLF = Size();
-		if (lastIsLF) { nextLF -= (IsWindows() ? 2 : 1); }
-	}
-	else {
+	uint64_t nextLF = Size();
+	if (line + 1 < lineFeedPositions.size()) {
 		nextLF = lineFeedPositions[line+1];
 	}
 	
-	uint64_t actualPos = IsWindows() ? pos + 2 : pos + 1;
 	std::string s;
 	for (uint64_t idx = actualPos; idx < nextLF; idx++) {
 		s += ABigBinaryFile::operator[](idx);
@@ -411,6 +473,9 @@ std::string ABigTextFile::operator[](uint64_t line) {
 	
 	AddToHistory(line, s);
 	
+	uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	lineStats.fetchLatency.Add(ns);
+	
 	return s;
 };
 
@@ -427,6 +492,15 @@ SST::StringArray ABigTextFile::AllLines() {
 	return ary;
 };
 
+double ABigTextFile::LineStats::HitRatio() const {
+	uint64_t total = hits + misses;
+	return total ? (double)hits / total : 0;
+};
+
+void ABigTextFile::ResetLineStats() {
+	lineStats = LineStats();
+};
+
 // Caller must call free()
 char* ABigTextFile::CString_F(uint64_t line) {
 	DebugPretty
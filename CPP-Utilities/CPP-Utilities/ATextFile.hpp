@@ -35,14 +35,12 @@ public:
 
 private:
 	NewLine textLF;
-	SST::StringArray lines;
-	
-	// A reference is needed so if it is the windows LF, we need to increment the index by
-	// another 1.
-	// See RetrieveLines()
-	bool IsLineFeed(uint64_t& idx);
+	// Shared by copies, as the blob is. RetrieveLines() builds a new array
+	// rather than modifying a shared one.
+	std::shared_ptr<const SST::StringArray> lines;
 	
 	// Parse through the loaded memory blob and retrieve all lines.
+	// Line feeds are found with ByteSearch.
 	void RetrieveLines();
 public:
 	
@@ -54,11 +52,16 @@ public:
 	
 	ATextFile(void* memoryBlock, uint64_t memSize, NewLine lf = NewLine::unix);
 	
+	// Borrow existing memory. See ABinaryFile(ByteSpan) for lifetime rules.
+	// Lines are still copied out into the line array.
+	ATextFile(ByteSpan view, NewLine lf = NewLine::unix);
+	
+	// O(1). Data and lines are shared with obj.
 	ATextFile(const ATextFile& obj);
-	ATextFile operator=(const ATextFile& obj);
+	ATextFile& operator=(const ATextFile& obj);
 	
 	ATextFile(ATextFile&& ref);
-	ATextFile operator=(ATextFile&& ref);
+	ATextFile& operator=(ATextFile&& ref);
 	
 	//------------------
 	// Clears lines array and retrieves them all again.
@@ -94,16 +97,20 @@ public:
  then we create the line.
 */
 class ABigTextFile : public ABigBinaryFile {
-	// List of all line feed positions. For the case of windows LF, this will
+	// 0, then the position of every line feed. For the case of windows LF, this will
 	// be the first char.
+	// Line n > 0 starts after lineFeedPositions[n], and ends at lineFeedPositions[n + 1]
+	// or the end of the file.
 	std::vector<uint64_t> lineFeedPositions;
+	// File bytes indexed so far.
+	uint64_t indexedSize;
 	
 	ATextFile::NewLine textLF;
 	
 	bool IsWindows() const { return textLF == ATextFile::NewLine::windows; }
 	
 	// If true, last character in file is the line feed character(s).
-	// Line count is either lineFeedPositions count or lineFeedPositions count + 1.
+	// Line count is either lineFeedPositions count or lineFeedPositions count - 1.
 	bool lastIsLF;
 	
 	// Key is line number, value is line.
@@ -114,6 +121,24 @@ class ABigTextFile : public ABigBinaryFile {
 	// Maximum number of lines in cache.
 	uint16_t maxLinesHeld;
 	
+public:
+	// Line cache counters since construction or ResetLineStats().
+	// Use with ABigBinaryFile::Stats() to choose maxLines and maxBlks.
+	struct LineStats {
+		// operator[] calls that found the line in the cache, and that did not.
+		uint64_t hits;
+		uint64_t misses;
+		// Lines dropped from the cache to make room.
+		uint64_t evictions;
+		// Time for operator[] to build a line not in the cache.
+		LatencyHistogram fetchLatency;
+		
+		// hits / lookups. 0 if there have been none.
+		double HitRatio() const;
+	};
+private:
+	LineStats lineStats;
+	
 	// If true, do not add line to history.
 	// Set by AllLines() so we do not waste time adding lines that will
 	// be removed in a few iterations.
@@ -124,23 +149,31 @@ class ABigTextFile : public ABigBinaryFile {
 	
 	// Determine positions of all line feeds.
 	void RetrieveLinePositions();
+	// Add the line feeds from position from to the end of the file. Scans each block
+	// in place with ByteSearch.
+	void IndexLines(uint64_t from);
+	
+	// Drop lines from first on from the line cache.
+	void ForgetLines(uint64_t first);
 	
-	// Will increment the idx by 1 if the new line is windows.
-	// See RetrieveLinePositions().
-	bool IsLineFeed(uint64_t& idx);
+	// See Update().
+	std::function<void(uint64_t first, uint64_t end)> appended;
 public:
 	ABigTextFile() = delete;
 	
 	// Will throw any exception that ABigBinaryFile will throw.
-	ABigTextFile(int desc, uint16_t blockSz, uint64_t maxBlks, uint16_t maxLines, ATextFile::NewLine lf = ATextFile::NewLine::unix);
-	ABigTextFile(const std::string& path, uint16_t blockSz, uint64_t maxBlks, uint16_t maxLines, ATextFile::NewLine lf = ATextFile::NewLine::unix);
+	ABigTextFile(int desc, uint32_t blockSz, uint64_t maxBlks, uint16_t maxLines, ATextFile::NewLine lf = ATextFile::NewLine::unix);
+	ABigTextFile(const std::string& path, uint32_t blockSz, uint64_t maxBlks, uint16_t maxLines, ATextFile::NewLine lf = ATextFile::NewLine::unix);
+	// Blocks are kept in cache, shared with other instances. See ABigBinaryFile.
+	ABigTextFile(int desc, std::shared_ptr<ASharedBlockCache> cache, uint16_t maxLines, ATextFile::NewLine lf = ATextFile::NewLine::unix);
+	ABigTextFile(const std::string& path, std::shared_ptr<ASharedBlockCache> cache, uint16_t maxLines, ATextFile::NewLine lf = ATextFile::NewLine::unix);
 	
 	// See ABigBinaryFile
 	ABigTextFile(const ABigTextFile& obj);
-	ABigTextFile operator=(const ABigTextFile& obj);
+	ABigTextFile& operator=(const ABigTextFile& obj);
 	
 	ABigTextFile(ABigTextFile&& ref);
-	ABigTextFile operator=(ABigTextFile&& ref);
+	ABigTextFile& operator=(ABigTextFile&& ref);
 	
 	// Purge cache
 	void Purge();
@@ -148,6 +181,17 @@ public:
 	// Calls Purge() & RetrieveLinePositions()
 	void Refresh();
 	
+	// Calls FileCheckIfChanged(). In follow mode (ABigBinaryFile::SetFollow()) growth only indexes
+	// the new bytes, and calls the OnAppend() callback with lines [first, end) that are
+	// new, or longer (the old last line if it had no line feed).
+	// Any other change calls Refresh().
+	// Returns the first new or changed line. LineCount() if there are none, 0 after
+	// Refresh(). With ABigBinaryFile::SetWatched(), an unchanged file costs one atomic load.
+	uint64_t Update();
+	
+	// Called by Update(), on this thread. nullptr for none.
+	void OnAppend(std::function<void(uint64_t first, uint64_t end)> proc) { appended = proc; }
+	
 	uint64_t LineCount() const;
 	
 	// If line >= line count, an ATFException wil be thrown.
@@ -161,6 +205,9 @@ public:
 	// Caller must call free()
 	char* CString_F(uint64_t line);
 	
+	LineStats LineCacheStats() const { return lineStats; }
+	void ResetLineStats();
+	
 	/*
 	Future:
 		Lock line (do not purge from cache or add it to a "permanent" history).
@@ -0,0 +1,342 @@
+//
+//  AsyncBlockLoader.cpp
+//  CPP-Utilities
+//
+//  Created by agent on 17/10/26.
+//  Copyright © 2026 tridiak. All rights reserved.
+//
+
+#include "AsyncBlockLoader.hpp"
+#include "ABinaryFile.hpp"
+#include "Debug.hpp"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <system_error>
+
+#if defined(ABinaryUseIOUring) && defined(__linux__)
+	#define UseRing 1
+	#include <linux/io_uring.h>
+	#include <sys/syscall.h>
+	#include <sys/mman.h>
+	#include <sys/uio.h>
+#endif
+
+// Most pool threads. More just queue in the kernel.
+#define MaxPoolThreads 32
+
+struct AsyncBlockLoader::Op {
+	Read read;
+	// Bytes read so far.
+	uint64_t done;
+#ifdef UseRing
+	struct iovec iov;
+#endif
+};
+
+//----
+
+#ifdef UseRing
+
+// user_data of the no-op that stops RingRun().
+#define StopTag 0
+
+struct AsyncBlockLoader::Ring {
+	int fd;
+	struct io_uring_params params;
+	void* sqMap;
+	size_t sqMapLen;
+	void* cqMap;
+	size_t cqMapLen;
+	struct io_uring_sqe* sqes;
+	size_t sqesLen;
+
+	unsigned* sqHead;
+	unsigned* sqTail;
+	unsigned* sqMask;
+	unsigned* sqArray;
+	unsigned* cqHead;
+	unsigned* cqTail;
+	unsigned* cqMask;
+	struct io_uring_cqe* cqes;
+
+	Ring() : fd(-1), sqMap(nullptr), cqMap(nullptr), sqes(nullptr) {}
+
+	~Ring() {
+		if (sqes) { munmap(sqes, sqesLen); }
+		if (cqMap && cqMap != sqMap) { munmap(cqMap, cqMapLen); }
+		if (sqMap) { munmap(sqMap, sqMapLen); }
+		if (fd >= 0) { close(fd); }
+	};
+
+	static void* Map(int fd, size_t len, off_t offset) {
+		void* ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+		return ptr == MAP_FAILED ? nullptr : ptr;
+	};
+
+	// Tell the kernel about count new entries and/or wait for a completion.
+	int Enter(unsigned count, unsigned wait) {
+		return (int)syscall(__NR_io_uring_enter, fd, count, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+	};
+
+	// Next free entry, or nullptr if the queue is full. Not visible until Publish().
+	struct io_uring_sqe* Next(unsigned& tail) {
+		unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+		if (tail - head >= params.sq_entries) { return nullptr; }
+		unsigned idx = tail & *sqMask;
+		sqArray[idx] = idx;
+		tail++;
+		memset(&sqes[idx], 0, sizeof(sqes[idx]));
+		return &sqes[idx];
+	};
+
+	// Hand every entry up to tail to the kernel.
+	void Publish(unsigned tail) {
+		__atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+		unsigned pending = tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+		// Entries refused now are picked up by the next call.
+		while (pending && Enter(pending, 0) < 0 && errno == EINTR) {}
+	};
+};
+
+#else
+
+struct AsyncBlockLoader::Ring {};
+
+#endif
+
+//----
+
+AsyncBlockLoader::AsyncBlockLoader(unsigned depth) : depth(depth ? depth : 1), outstanding(0), stop(false), inRing(0) {
+	DebugPretty
+
+	try {
+		if (RingSetup()) {
+			threads.emplace_back(&AsyncBlockLoader::RingRun, this);
+			return;
+		}
+		unsigned count = std::min(this->depth, (unsigned)MaxPoolThreads);
+		for (unsigned t = 0; t < count; t++) {
+			threads.emplace_back(&AsyncBlockLoader::PoolRun, this);
+		}
+	}
+	catch (const std::system_error&) {
+		// A smaller pool still works.
+		if (ring || threads.empty()) {
+			if (!threads.empty()) {
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					stop = true;
+				}
+				wake.notify_all();
+				for (std::thread& T : threads) { T.join(); }
+			}
+			throw ABinaryFile::ABinaryFileEx("Could not start a loader thread");
+		}
+	}
+};
+
+AsyncBlockLoader::~AsyncBlockLoader() {
+	DebugPretty
+
+	Wait();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stop = true;
+#ifdef UseRing
+		if (ring) {
+			unsigned tail = *ring->sqTail;
+			struct io_uring_sqe* sqe = ring->Next(tail);
+			// Nothing is in flight, so there is room.
+			sqe->opcode = IORING_OP_NOP;
+			sqe->user_data = StopTag;
+			ring->Publish(tail);
+		}
+#endif
+	}
+	wake.notify_all();
+	for (std::thread& T : threads) { T.join(); }
+};
+
+//----
+
+void AsyncBlockLoader::Submit(std::vector<Read>& reads) {
+	if (reads.empty()) { return; }
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (Read& R : reads) {
+			Op* op = new Op;
+			op->read = std::move(R);
+			op->done = 0;
+			queue.push_back(op);
+			outstanding++;
+		}
+		if (ring) { RingSubmit(); }
+	}
+	reads.clear();
+	if (!ring) { wake.notify_all(); }
+};
+
+void AsyncBlockLoader::Wait() {
+	std::unique_lock<std::mutex> guard(lock);
+	idle.wait(guard, [this]() { return outstanding == 0; });
+};
+
+void AsyncBlockLoader::Finish(Op* op, int64_t result) {
+	op->read.done(result);
+	delete op;
+
+	std::lock_guard<std::mutex> guard(lock);
+	if (--outstanding == 0) { idle.notify_all(); }
+};
+
+//----
+
+void AsyncBlockLoader::PoolRun() {
+	for (;;) {
+		Op* op;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this]() { return stop || !queue.empty(); });
+			if (queue.empty()) { return; }
+			op = queue.front();
+			queue.pop_front();
+		}
+
+		const Read& R = op->read;
+		uint8_t* p = (uint8_t*)R.dest;
+		int64_t result = 0;
+		while ((uint64_t)result < R.len) {
+			ssize_t ct = pread(R.desc, p + result, R.len - result, R.pos + result);
+			if (ct < 0 && errno == EINTR) { continue; }
+			// An O_DIRECT descriptor refuses the unaligned read after a short one at end of file.
+			if (ct < 0 && errno == EINVAL && result > 0) { break; }
+			if (ct < 0) {
+				result = -errno;
+				break;
+			}
+			if (ct == 0) { break; }
+			result += ct;
+		}
+		Finish(op, result);
+	}
+};
+
+//----
+
+bool AsyncBlockLoader::RingSetup() {
+#ifdef UseRing
+	std::unique_ptr<Ring> R(new Ring);
+	struct io_uring_params& p = R->params;
+	memset(&p, 0, sizeof(p));
+	R->fd = (int)syscall(__NR_io_uring_setup, depth, &p);
+	if (R->fd < 0) { return false; }
+
+	R->sqMapLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	R->cqMapLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single) { R->sqMapLen = R->cqMapLen = std::max(R->sqMapLen, R->cqMapLen); }
+
+	R->sqMap = Ring::Map(R->fd, R->sqMapLen, IORING_OFF_SQ_RING);
+	if (!R->sqMap) { return false; }
+	R->cqMap = single ? R->sqMap : Ring::Map(R->fd, R->cqMapLen, IORING_OFF_CQ_RING);
+	if (!R->cqMap) { return false; }
+	R->sqesLen = p.sq_entries * sizeof(struct io_uring_sqe);
+	R->sqes = (struct io_uring_sqe*)Ring::Map(R->fd, R->sqesLen, IORING_OFF_SQES);
+	if (!R->sqes) { return false; }
+
+	uint8_t* sq = (uint8_t*)R->sqMap;
+	R->sqHead = (unsigned*)(sq + p.sq_off.head);
+	R->sqTail = (unsigned*)(sq + p.sq_off.tail);
+	R->sqMask = (unsigned*)(sq + p.sq_off.ring_mask);
+	R->sqArray = (unsigned*)(sq + p.sq_off.array);
+	uint8_t* cq = (uint8_t*)R->cqMap;
+	R->cqHead = (unsigned*)(cq + p.cq_off.head);
+	R->cqTail = (unsigned*)(cq + p.cq_off.tail);
+	R->cqMask = (unsigned*)(cq + p.cq_off.ring_mask);
+	R->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+	// The stop no-op needs an entry on top of depth reads.
+	depth = std::min(depth, p.sq_entries - 1);
+	if (depth == 0) { return false; }
+	ring = std::move(R);
+	return true;
+#else
+	return false;
+#endif
+};
+
+void AsyncBlockLoader::RingSubmit() {
+#ifdef UseRing
+	unsigned tail = *ring->sqTail;
+	unsigned added = 0;
+	while (!queue.empty() && inRing < depth) {
+		struct io_uring_sqe* sqe = ring->Next(tail);
+		if (!sqe) { break; }
+		Op* op = queue.front();
+		queue.pop_front();
+
+		op->iov.iov_base = (uint8_t*)op->read.dest + op->done;
+		op->iov.iov_len = op->read.len - op->done;
+		sqe->opcode = IORING_OP_READV;
+		sqe->fd = op->read.desc;
+		sqe->addr = (uint64_t)(uintptr_t)&op->iov;
+		sqe->len = 1;
+		sqe->off = op->read.pos + op->done;
+		sqe->user_data = (uint64_t)(uintptr_t)op;
+		inRing++;
+		added++;
+	}
+	if (added) { ring->Publish(tail); }
+#endif
+};
+
+void AsyncBlockLoader::RingRun() {
+#ifdef UseRing
+	bool stopping = false;
+	std::vector<std::pair<Op*, int64_t>> finished;
+	while (!stopping) {
+		if (ring->Enter(0, 1) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+			// Should not happen. Keep waiting rather than lose reads.
+			std::this_thread::yield();
+		}
+
+		finished.clear();
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			unsigned head = *ring->cqHead;
+			unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+			for (; head != tail; head++) {
+				const struct io_uring_cqe& cqe = ring->cqes[head & *ring->cqMask];
+				if (cqe.user_data == StopTag) {
+					stopping = true;
+					continue;
+				}
+				Op* op = (Op*)(uintptr_t)cqe.user_data;
+				int res = cqe.res;
+				inRing--;
+
+				if (res == -EINTR || res == -EAGAIN) {
+					queue.push_front(op);
+				}
+				else if (res > 0 && op->done + res < op->read.len) {
+					// Short. Read the rest, or find it was the end of the file.
+					op->done += res;
+					queue.push_front(op);
+				}
+				else if (res < 0 && !(res == -EINVAL && op->done > 0)) {
+					finished.push_back(std::make_pair(op, (int64_t)res));
+				}
+				else {
+					finished.push_back(std::make_pair(op, (int64_t)(op->done + std::max(res, 0))));
+				}
+			}
+			__atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+			RingSubmit();
+		}
+
+		for (auto& F : finished) { Finish(F.first, F.second); }
+	}
+#endif
+};
@@ -0,0 +1,98 @@
+//
+//  AsyncBlockLoader.hpp
+//  CPP-Utilities
+//
+//  Created by agent on 17/10/26.
+//  Copyright © 2026 tridiak. All rights reserved.
+//
+
+#ifndef AsyncBlockLoader_hpp
+#define AsyncBlockLoader_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+// Define to read with io_uring on Linux (kernel 5.1 or later). If the ring can not
+// be set up, as in a sandbox that blocks it, the thread pool is used instead.
+// #define ABinaryUseIOUring 1
+
+/*
+ Many positional reads in flight at once, each reported to a callback when done.
+ Used by ABigBinaryFile::LoadBlocksAsync().
+
+ With io_uring, a batch from Submit() is queued to the kernel in one system call,
+ up to depth reads at a time, and one thread takes the completions.
+ Otherwise depth threads (at most 32) each pread() one read at a time.
+
+ Reads are retried until len bytes are read, end of file or an error, so a short
+ result means end of file.
+ Callbacks run on a loader thread, one at a time with io_uring, and must not
+ call Wait().
+
+ Thread safe. The destructor waits for every read to finish.
+*/
+
+class AsyncBlockLoader {
+public:
+	// done gets the bytes read, or -errno.
+	struct Read {
+		int desc;
+		void* dest;
+		uint64_t len;
+		uint64_t pos;
+		std::function<void(int64_t)> done;
+	};
+private:
+	struct Op;
+
+	unsigned depth;
+
+	std::mutex lock;
+	std::condition_variable idle;
+	// Submitted and not yet done.
+	uint64_t outstanding;
+	bool stop;
+
+	// Thread pool, or reads not yet given to the ring.
+	std::deque<Op*> queue;
+	std::condition_variable wake;
+	std::vector<std::thread> threads;
+
+	struct Ring;
+	std::unique_ptr<Ring> ring;
+	// Reads given to the ring and not yet completed.
+	unsigned inRing;
+
+	void Finish(Op* op, int64_t result);
+	void PoolRun();
+
+	bool RingSetup();
+	// Give queued reads to the ring, up to depth in flight. Caller holds lock.
+	void RingSubmit();
+	void RingRun();
+public:
+	// Throws ABinaryFile::ABinaryFileEx if no thread can be started.
+	explicit AsyncBlockLoader(unsigned depth = 64);
+	AsyncBlockLoader(const AsyncBlockLoader&) = delete;
+	AsyncBlockLoader& operator=(const AsyncBlockLoader&) = delete;
+	~AsyncBlockLoader();
+
+	// Returns at once. reads is emptied.
+	void Submit(std::vector<Read>& reads);
+
+	// Until every read submitted so far is done.
+	void Wait();
+
+	// True if reads go through io_uring.
+	bool IOUring() const { return ring != nullptr; }
+	unsigned Depth() const { return depth; }
+};
+
+#endif /* AsyncBlockLoader_hpp */
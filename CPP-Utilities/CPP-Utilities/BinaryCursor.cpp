@@ -0,0 +1,52 @@
+//
+//  BinaryCursor.cpp
+//  CPP-Utilities
+//
+//  Created by agent on 17/10/26.
+//  Copyright © 2026 tridiak. All rights reserved.
+//
+
+#include "BinaryCursor.hpp"
+
+ABinaryCursor::ABinaryCursor(const ABinaryFile& file, uint64_t start) {
+	data = (const uint8_t*)file.Blob();
+	size = file.Size();
+	pos = 0;
+	Seek(start);
+};
+
+ABinaryCursor::ABinaryCursor(ByteSpan bytes, uint64_t start) {
+	data = bytes.data;
+	size = bytes.size;
+	pos = 0;
+	Seek(start);
+};
+
+//----
+
+void ABinaryCursor::RangeError() {
+	throw ABinaryFile::ABinaryFileEx("Out of range");
+};
+
+void ABinaryCursor::VarintError() {
+	throw ABinaryFile::ABinaryFileEx("Malformed varint");
+};
+
+//----
+
+uint64_t ABinaryCursor::ReadVarintSlow() {
+	uint64_t v = 0;
+	uint64_t idx = pos;
+	for (unsigned shift = 0; shift < 70; shift += 7) {
+		if (idx >= size) { RangeError(); }
+		uint8_t b = data[idx++];
+		// The tenth byte can only hold the top bit of a 64 bit value.
+		if (shift == 63 && b > 1) { VarintError(); }
+		v |= (uint64_t)(b & 0x7F) << shift;
+		if (b < 0x80) {
+			pos = idx;
+			return v;
+		}
+	}
+	VarintError();
+};
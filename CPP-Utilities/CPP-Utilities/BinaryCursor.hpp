@@ -0,0 +1,131 @@
+//
+//  BinaryCursor.hpp
+//  CPP-Utilities
+//
+//  Created by agent on 17/10/26.
+//  Copyright © 2026 tridiak. All rights reserved.
+//
+
+#ifndef BinaryCursor_hpp
+#define BinaryCursor_hpp
+
+#include <stdio.h>
+#include "ABinaryFile.hpp"
+#include "ByteOrder.hpp"
+
+/*
+ Forward reader over an ABinaryFile blob or any ByteSpan.
+ It keeps its own position so records can be decoded without computing offsets.
+
+ Each reader comes in two flavours:
+	ReadX()		- checks the remaining length and throws ABinaryFileEx if the data
+				  runs out. The position is not moved if it throws.
+	ReadX_U()	- no check at all. Call Require() (or Has()) once for the whole record,
+				  then use these for the fields.
+
+ The cursor does not own anything. The file or memory must outlive it.
+ Varints are unsigned LEB128, at most 10 bytes. ZigZag is the protobuf encoding.
+*/
+
+class ABinaryCursor {
+	const uint8_t* data;
+	uint64_t size;
+	uint64_t pos;
+
+	// Out of line so the inline readers stay small.
+	[[noreturn]] static void RangeError();
+	[[noreturn]] static void VarintError();
+
+	// Checked varint read close to the end of the data.
+	uint64_t ReadVarintSlow();
+
+	template<class T> T LoadLE() { T v = ByteOrder::Load<T>(data + pos, ByteOrder::Endian::little); pos += sizeof(T); return v; }
+	template<class T> T LoadBE() { T v = ByteOrder::Load<T>(data + pos, ByteOrder::Endian::big); pos += sizeof(T); return v; }
+
+public:
+	// Throws ABinaryFileEx if start > size.
+	ABinaryCursor(const ABinaryFile& file, uint64_t start = 0);
+	ABinaryCursor(ByteSpan bytes, uint64_t start = 0);
+
+	uint64_t Position() const { return pos; }
+	uint64_t Size() const { return size; }
+	uint64_t Remaining() const { return size - pos; }
+	bool AtEnd() const { return pos == size; }
+
+	// Throws ABinaryFileEx if position > size.
+	void Seek(uint64_t position) { if (position > size) { RangeError(); } pos = position; }
+
+	// True if len bytes remain.
+	bool Has(uint64_t len) const { return len <= size - pos; }
+
+	// Throws ABinaryFileEx if fewer than len bytes remain.
+	void Require(uint64_t len) const { if (!Has(len)) { RangeError(); } }
+
+	//--------------------------
+	// Checked
+
+	uint8_t ReadU8() { Require(1); return data[pos++]; }
+
+	uint16_t ReadU16LE() { Require(2); return LoadLE<uint16_t>(); }
+	uint32_t ReadU32LE() { Require(4); return LoadLE<uint32_t>(); }
+	uint64_t ReadU64LE() { Require(8); return LoadLE<uint64_t>(); }
+
+	uint16_t ReadU16BE() { Require(2); return LoadBE<uint16_t>(); }
+	uint32_t ReadU32BE() { Require(4); return LoadBE<uint32_t>(); }
+	uint64_t ReadU64BE() { Require(8); return LoadBE<uint64_t>(); }
+
+	// Throws ABinaryFileEx if the varint is truncated or longer than 10 bytes.
+	uint64_t ReadVarint() {
+		// Enough room for the longest varint, so no per-byte check is needed.
+		if (Has(10)) {
+			uint64_t start = pos;
+			uint64_t v = ReadVarint_U();
+			if (pos - start == 10 && data[pos - 1] > 1) { pos = start; VarintError(); }
+			return v;
+		}
+		return ReadVarintSlow();
+	}
+
+	int64_t ReadZigZag() { uint64_t v = ReadVarint(); return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+	// Copies len bytes to dest.
+	void ReadBytes(void* dest, uint64_t len) { Require(len); memcpy(dest, data + pos, len); pos += len; }
+
+	// View of the next len bytes. Nothing is copied.
+	ByteSpan ReadBytes(uint64_t len) { Require(len); ByteSpan S(data + pos, len); pos += len; return S; }
+
+	void Skip(uint64_t len) { Require(len); pos += len; }
+
+	//--------------------------
+	// Unchecked. Caller has called Require() for enough bytes.
+
+	uint8_t ReadU8_U() { return data[pos++]; }
+
+	uint16_t ReadU16LE_U() { return LoadLE<uint16_t>(); }
+	uint32_t ReadU32LE_U() { return LoadLE<uint32_t>(); }
+	uint64_t ReadU64LE_U() { return LoadLE<uint64_t>(); }
+
+	uint16_t ReadU16BE_U() { return LoadBE<uint16_t>(); }
+	uint32_t ReadU32BE_U() { return LoadBE<uint32_t>(); }
+	uint64_t ReadU64BE_U() { return LoadBE<uint64_t>(); }
+
+	// Reads at most 10 bytes. Require(10) covers any varint.
+	uint64_t ReadVarint_U() {
+		uint64_t v = 0;
+		for (unsigned shift = 0; shift < 70; shift += 7) {
+			uint8_t b = data[pos++];
+			v |= (uint64_t)(b & 0x7F) << shift;
+			if (b < 0x80) { break; }
+		}
+		return v;
+	}
+
+	int64_t ReadZigZag_U() { uint64_t v = ReadVarint_U(); return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+	void ReadBytes_U(void* dest, uint64_t len) { memcpy(dest, data + pos, len); pos += len; }
+	ByteSpan ReadBytes_U(uint64_t len) { ByteSpan S(data + pos, len); pos += len; return S; }
+
+	void Skip_U(uint64_t len) { pos += len; }
+};
+
+#endif /* BinaryCursor_hpp */
@@ -0,0 +1,525 @@
+//
+//  BlockCache.cpp
+//  CPP-Utilities
+//
+//  Created by agent on 17/10/26.
+//  Copyright © 2026 tridiak. All rights reserved.
+//
+
+#include "BlockCache.hpp"
+#include "ABinaryFile.hpp"
+#include "Debug.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <algorithm>
+#include <thread>
+
+ABlockCache::ABlockCache(uint64_t blockSize, uint64_t slotCount, Policy policy, bool mapped)
+		: blockSize(blockSize), slotCount(slotCount), policy(policy), mapped(mapped), groupBits(0), target(0), hits(0), misses(0), evictions(0), prefetchHits(0) {
+	DebugPretty
+
+	if (blockSize == 0 || slotCount == 0) { throw ABinaryFile::ABinaryFileEx("Invalid block cache size"); }
+	if (blockSize > UINT64_MAX / slotCount) { throw ABinaryFile::ABinaryFileEx("Block array memory failure"); }
+
+	if (mapped) {
+		if (blockSize % PageSize() != 0) { throw ABinaryFile::ABinaryFileEx("Mapped block size is not a page multiple"); }
+		// Address space only, until windows are mapped over it.
+		void* mem = mmap(nullptr, slotCount * blockSize, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+		if (mem == MAP_FAILED) { throw ABinaryFile::ABinaryFileEx("Block array memory failure"); }
+		memory = (uint8_t*)mem;
+	}
+	else {
+		// Not zeroed. Slots are filled before use, and untouched pages cost nothing.
+		void* mem = nullptr;
+		if (posix_memalign(&mem, PageSize(), slotCount * blockSize) != 0) {
+			throw ABinaryFile::ABinaryFileEx("Block array memory failure");
+		}
+		memory = (uint8_t*)mem;
+	}
+
+	tags.reset(new std::atomic<uint64_t>[slotCount]);
+	pins.reset(new std::atomic<uint32_t>[slotCount]);
+	for (uint64_t t = 0; t < slotCount; t++) {
+		tags[t].store(0, std::memory_order_relaxed);
+		pins[t].store(0, std::memory_order_relaxed);
+	}
+
+	slots.resize(slotCount + listCount);
+	for (unsigned L = 0; L < listCount; L++) {
+		slots[Head(L)].prev = slots[Head(L)].next = Head(L);
+		listSize[L] = 0;
+	}
+	index.reserve(slotCount);
+
+	// Lowest slot on top.
+	freeSlots.reserve(slotCount);
+	for (uint64_t t = slotCount; t > 0; t--) {
+		freeSlots.push_back(t - 1);
+	}
+};
+
+ABlockCache::~ABlockCache() {
+	if (mapped) { munmap(memory, slotCount * blockSize); }
+	else { free(memory); }
+};
+
+uint64_t ABlockCache::PageSize() {
+	static const long page = sysconf(_SC_PAGESIZE);
+	return page > 0 ? page : 4096;
+};
+
+//----
+
+void ABlockCache::Grouped(GroupIndex& groups, unsigned bits, uint64_t block, bool add) {
+	if (bits == 0) { return; }
+	if (add) {
+		groups[block >> bits].insert(block);
+		return;
+	}
+	auto itr = groups.find(block >> bits);
+	if (itr == groups.end()) { return; }
+	itr->second.erase(block);
+	if (itr->second.empty()) { groups.erase(itr); }
+};
+
+//----
+
+void ABlockCache::Ghosts::Add(uint64_t block) {
+	Remove(block);
+	order.push_front(block);
+	index[block] = order.begin();
+	Grouped(groups, groupBits, block, true);
+};
+
+void ABlockCache::Ghosts::Remove(uint64_t block) {
+	auto itr = index.find(block);
+	if (itr == index.end()) { return; }
+	order.erase(itr->second);
+	index.erase(itr);
+	Grouped(groups, groupBits, block, false);
+};
+
+void ABlockCache::Ghosts::DropOldest() {
+	Grouped(groups, groupBits, order.back(), false);
+	index.erase(order.back());
+	order.pop_back();
+};
+
+void ABlockCache::Ghosts::Clear() {
+	order.clear();
+	index.clear();
+	groups.clear();
+};
+
+void ABlockCache::Ghosts::RemoveGroup(uint64_t group) {
+	auto itr = groups.find(group);
+	if (itr == groups.end()) { return; }
+	for (uint64_t block : itr->second) {
+		auto I = index.find(block);
+		order.erase(I->second);
+		index.erase(I);
+	}
+	groups.erase(itr);
+};
+
+//----
+
+void ABlockCache::Unlink(uint64_t slot) {
+	Slot& S = slots[slot];
+	slots[S.prev].next = S.next;
+	slots[S.next].prev = S.prev;
+	listSize[S.list]--;
+};
+
+void ABlockCache::LinkFront(uint64_t slot, unsigned list) {
+	Slot& S = slots[slot];
+	S.list = list;
+	S.prev = Head(list);
+	S.next = slots[Head(list)].next;
+	slots[S.next].prev = slot;
+	slots[Head(list)].next = slot;
+	listSize[list]++;
+};
+
+//----
+
+void ABlockCache::Touch(uint64_t slot) {
+	switch (policy) {
+		case Policy::clock:
+			slots[slot].referenced = true;
+			return;
+		case Policy::twoQ:
+			// Probation is first in first out.
+			if (slots[slot].list == probationList) { return; }
+			break;
+		default:
+			break;
+	}
+
+	// Newest of mainList. arc promotes from probation.
+	if (slots[slot].list == mainList && slots[Head(mainList)].next == slot) { return; }
+	Unlink(slot);
+	LinkFront(slot, mainList);
+};
+
+uint64_t ABlockCache::Oldest(unsigned list) const {
+	// Pins only go up under the caller's lock, so one seen as zero here stays zero.
+	uint64_t slot = slots[Head(list)].prev;
+	while (slot != Head(list) && pins[slot].load(std::memory_order_acquire) > 0) {
+		slot = slots[slot].prev;
+	}
+	return slot == Head(list) ? noSlot : slot;
+};
+
+uint64_t ABlockCache::Victim(uint64_t block) {
+	unsigned first = mainList;
+	switch (policy) {
+		case Policy::lru:
+			return Oldest(mainList);
+
+		case Policy::clock:
+			// The hand is at the oldest end. Flagged and pinned slots go round again,
+			// flags cleared, so two turns find any unpinned slot.
+			for (uint64_t t = 2 * listSize[mainList]; t > 0; t--) {
+				uint64_t slot = slots[Head(mainList)].prev;
+				if (!slots[slot].referenced && pins[slot].load(std::memory_order_acquire) == 0) { return slot; }
+				slots[slot].referenced = false;
+				Unlink(slot);
+				LinkFront(slot, mainList);
+			}
+			return noSlot;
+
+		case Policy::twoQ:
+			// Probation gives up its oldest once over its quarter.
+			if (listSize[probationList] > std::max<uint64_t>(slotCount / 4, 1) || listSize[mainList] == 0) {
+				first = probationList;
+			}
+			break;
+
+		case Policy::arc: {
+			uint64_t t1 = listSize[probationList];
+			if (t1 > 0 && (t1 > target || (t1 == target && ghosts[1].Contains(block)))) {
+				first = probationList;
+			}
+			break;
+		}
+	}
+
+	uint64_t slot = Oldest(first);
+	return slot != noSlot ? slot : Oldest(first == mainList ? probationList : mainList);
+};
+
+void ABlockCache::Evict(uint64_t slot) {
+	unsigned list = slots[slot].list;
+	uint64_t block = slots[slot].block;
+	Unlink(slot);
+	index.erase(block);
+	Grouped(groups, groupBits, block, false);
+
+	if (policy == Policy::twoQ && list == probationList) { ghosts[0].Add(block); }
+	else if (policy == Policy::arc) { ghosts[list == probationList ? 0 : 1].Add(block); }
+};
+
+void ABlockCache::TrimGhosts() {
+	if (policy == Policy::twoQ) {
+		while (ghosts[0].Size() > std::max<uint64_t>(slotCount / 2, 1)) { ghosts[0].DropOldest(); }
+	}
+	else if (policy == Policy::arc) {
+		while (ghosts[0].Size() > 0 && listSize[probationList] + ghosts[0].Size() > slotCount) {
+			ghosts[0].DropOldest();
+		}
+		while (ghosts[1].Size() > 0 && Count() + ghosts[0].Size() + ghosts[1].Size() > 2 * slotCount) {
+			ghosts[1].DropOldest();
+		}
+	}
+};
+
+//----
+
+uint8_t* ABlockCache::Find(uint64_t block) {
+	auto itr = index.find(block);
+	if (itr == index.end()) {
+		misses++;
+		return nullptr;
+	}
+
+	hits++;
+	Slot& S = slots[itr->second];
+	if (S.prefetched) {
+		S.prefetched = false;
+		prefetchHits++;
+	}
+	Touch(itr->second);
+	return memory + itr->second * blockSize;
+};
+
+const uint8_t* ABlockCache::Peek(uint64_t block) const {
+	auto itr = index.find(block);
+	if (itr == index.end()) { return nullptr; }
+	return memory + itr->second * blockSize;
+};
+
+bool ABlockCache::Contains(uint64_t block) const {
+	return index.find(block) != index.end();
+};
+
+//----
+
+uint8_t* ABlockCache::Insert(uint64_t block, int64_t& evicted) {
+	evicted = -1;
+
+	auto itr = index.find(block);
+	if (itr != index.end()) {
+		Touch(itr->second);
+		return memory + itr->second * blockSize;
+	}
+
+	if (!orphans.empty()) { ReclaimOrphans(); }
+
+	// arc: a remembered eviction moves the target toward the list it was evicted from.
+	if (policy == Policy::arc) {
+		uint64_t b1 = ghosts[0].Size();
+		uint64_t b2 = ghosts[1].Size();
+		if (ghosts[0].Contains(block)) {
+			target = std::min(slotCount, target + std::max<uint64_t>(b2 / b1, 1));
+		}
+		else if (ghosts[1].Contains(block)) {
+			uint64_t d = std::max<uint64_t>(b1 / b2, 1);
+			target = target > d ? target - d : 0;
+		}
+	}
+
+	uint64_t slot;
+	if (freeSlots.empty()) {
+		slot = Victim(block);
+		if (slot == noSlot) { return nullptr; }
+		evicted = slots[slot].block;
+		Evict(slot);
+		evictions++;
+	}
+	else {
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+
+	// Anyone still reading the old block through Tag() will see it change.
+	tags[slot].store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	// A remembered block has been used before, so skips probation.
+	unsigned list = mainList;
+	if (policy == Policy::twoQ || policy == Policy::arc) {
+		list = probationList;
+		for (Ghosts& G : ghosts) {
+			if (G.Contains(block)) {
+				G.Remove(block);
+				list = mainList;
+			}
+		}
+	}
+
+	slots[slot].block = block;
+	slots[slot].referenced = false;
+	slots[slot].prefetched = false;
+	LinkFront(slot, list);
+	index[block] = slot;
+	Grouped(groups, groupBits, block, true);
+	TrimGhosts();
+
+	return memory + slot * blockSize;
+};
+
+void ABlockCache::Filled(const uint8_t* slot) {
+	uint64_t idx = SlotOf(slot);
+	tags[idx].store(slots[idx].block + 1, std::memory_order_release);
+};
+
+bool ABlockCache::MapFile(const uint8_t* slot, int desc, uint64_t offset) {
+	void* at = memory + SlotOf(slot) * blockSize;
+	if (mmap(at, blockSize, PROT_READ, MAP_SHARED | MAP_FIXED, desc, offset) != MAP_FAILED) { return true; }
+	// A failed MAP_FIXED can leave the range unmapped, where something else could be put.
+	int err = errno;
+	Unmap(SlotOf(slot));
+	errno = err;
+	return false;
+};
+
+void ABlockCache::Unmap(uint64_t slot) {
+	mmap(memory + slot * blockSize, blockSize, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE | MAP_FIXED, -1, 0);
+};
+
+void ABlockCache::Remove(uint64_t block) {
+	auto itr = index.find(block);
+	if (itr == index.end()) { return; }
+
+	uint64_t slot = itr->second;
+	tags[slot].store(0, std::memory_order_relaxed);
+	Unlink(slot);
+	index.erase(itr);
+	Grouped(groups, groupBits, block, false);
+	if (pins[slot].load(std::memory_order_acquire) > 0) {
+		orphans.push_back(slot);
+		return;
+	}
+	freeSlots.push_back(slot);
+	if (mapped) { Unmap(slot); }
+};
+
+void ABlockCache::RemoveGroup(uint64_t group) {
+	auto itr = groups.find(group);
+	if (itr != groups.end()) {
+		// Remove() changes the set.
+		std::vector<uint64_t> blocks(itr->second.begin(), itr->second.end());
+		for (uint64_t block : blocks) { Remove(block); }
+	}
+	for (Ghosts& G : ghosts) { G.RemoveGroup(group); }
+};
+
+void ABlockCache::ReclaimOrphans() {
+	for (size_t t = 0; t < orphans.size(); ) {
+		if (pins[orphans[t]].load(std::memory_order_acquire) == 0) {
+			freeSlots.push_back(orphans[t]);
+			// As Remove() does for a slot that was not pinned.
+			if (mapped) { Unmap(orphans[t]); }
+			orphans[t] = orphans.back();
+			orphans.pop_back();
+		}
+		else {
+			t++;
+		}
+	}
+};
+
+bool ABlockCache::AnyPinned() const {
+	for (uint64_t t = 0; t < slotCount; t++) {
+		if (pins[t].load(std::memory_order_acquire) != 0) { return true; }
+	}
+	return false;
+};
+
+void ABlockCache::Clear(bool zero) {
+	DebugPretty
+
+	for (auto& I : index) {
+		tags[I.second].store(0, std::memory_order_relaxed);
+	}
+	index.clear();
+	groups.clear();
+	for (unsigned L = 0; L < listCount; L++) {
+		slots[Head(L)].prev = slots[Head(L)].next = Head(L);
+		listSize[L] = 0;
+	}
+	for (Ghosts& G : ghosts) { G.Clear(); }
+	target = 0;
+
+	// Pinned slots are still being read. They are no longer found by block number,
+	// and are freed once unpinned.
+	freeSlots.clear();
+	orphans.clear();
+	for (uint64_t t = slotCount; t > 0; t--) {
+		uint64_t slot = t - 1;
+		if (pins[slot].load(std::memory_order_acquire) > 0) {
+			orphans.push_back(slot);
+			continue;
+		}
+		freeSlots.push_back(slot);
+		// Slots of a mapped cache are never written.
+		if (mapped) { Unmap(slot); }
+		else if (zero) { memset(memory + slot * blockSize, 0, blockSize); }
+	}
+};
+
+//----
+
+std::vector<uint64_t> ABlockCache::Blocks() const {
+	std::vector<uint64_t> blocks;
+	blocks.reserve(index.size());
+	for (unsigned L : {probationList, mainList}) {
+		for (uint64_t s = slots[Head(L)].prev; s != Head(L); s = slots[s].prev) {
+			blocks.push_back(slots[s].block);
+		}
+	}
+	return blocks;
+};
+
+double ABlockCache::HitRatio() const {
+	uint64_t total = hits + misses;
+	return total ? (double)hits / total : 0;
+};
+
+//---------------------------------------------------------------
+#pragma mark - Shared
+
+ASharedBlockCache::ASharedBlockCache(uint64_t blockSize, uint64_t budget, ABlockCache::Policy policy, unsigned shardCount)
+		: blockSize(blockSize), policy(policy), shardCount(shardCount), nextOwner(1) {
+	DebugPretty
+
+	slotCount = blockSize ? budget / blockSize : 0;
+	if (slotCount == 0) { throw ABinaryFile::ABinaryFileEx("Shared cache budget is less than a block"); }
+
+	if (this->shardCount == 0) {
+		// As ABigBinaryFile in ThreadMode::concurrent.
+		unsigned hw = std::thread::hardware_concurrency();
+		this->shardCount = (hw ? hw : 1) * 4;
+	}
+	if (this->shardCount > slotCount) { this->shardCount = (unsigned)slotCount; }
+
+	shards.reset(new ABlockCacheShard[this->shardCount]);
+	for (unsigned t = 0; t < this->shardCount; t++) {
+		uint64_t slots = slotCount / this->shardCount + (t < slotCount % this->shardCount ? 1 : 0);
+		shards[t].cache.reset(new ABlockCache(blockSize, slots, policy));
+		shards[t].cache->GroupBy(blockBits);
+	}
+};
+
+//----
+
+uint32_t ASharedBlockCache::Join() {
+	std::lock_guard<std::mutex> guard(ownerLock);
+	if (!freeOwners.empty()) {
+		uint32_t owner = freeOwners.back();
+		freeOwners.pop_back();
+		return owner;
+	}
+	if (nextOwner > maxOwners) { throw ABinaryFile::ABinaryFileEx("Too many shared cache users"); }
+	return nextOwner++;
+};
+
+void ASharedBlockCache::Leave(uint32_t owner) {
+	if (owner == 0) { return; }
+	// Before the number can be reused.
+	Purge(owner);
+	std::lock_guard<std::mutex> guard(ownerLock);
+	freeOwners.push_back(owner);
+};
+
+void ASharedBlockCache::Purge(uint32_t owner) {
+	DebugPretty
+
+	for (unsigned t = 0; t < shardCount; t++) {
+		std::lock_guard<std::mutex> guard(shards[t].lock);
+		shards[t].cache->RemoveGroup(owner);
+	}
+};
+
+//----
+
+static std::mutex globalLock;
+static std::shared_ptr<ASharedBlockCache> globalCache;
+
+std::shared_ptr<ASharedBlockCache> ASharedBlockCache::Global() {
+	std::lock_guard<std::mutex> guard(globalLock);
+	if (!globalCache) { globalCache = std::make_shared<ASharedBlockCache>(65536, 256ULL << 20); }
+	return globalCache;
+};
+
+std::shared_ptr<ASharedBlockCache> ASharedBlockCache::ConfigureGlobal(uint64_t blockSize, uint64_t budget,
+				ABlockCache::Policy policy) {
+	std::shared_ptr<ASharedBlockCache> cache = std::make_shared<ASharedBlockCache>(blockSize, budget, policy);
+	std::lock_guard<std::mutex> guard(globalLock);
+	globalCache = cache;
+	return cache;
+};
@@ -0,0 +1,351 @@
+//
+//  BlockCache.hpp
+//  CPP-Utilities
+//
+//  Created by agent on 17/10/26.
+//  Copyright © 2026 tridiak. All rights reserved.
+//
+
+#ifndef BlockCache_hpp
+#define BlockCache_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <list>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+/*
+ Fixed number of fixed size slots holding file blocks. Used by ABigBinaryFile.
+
+ Eviction policies (see Policy):
+ - lru: least recently used.
+ - clock: second chance. A hit only sets a flag, so it is cheaper than lru, at
+   the cost of a coarser order.
+ - twoQ: new blocks go on a probation list, which takes a quarter of the slots.
+   Blocks evicted from probation are remembered, and go to the main list if
+   loaded again. Hits on probation do nothing. A sequential scan passes through
+   probation without touching the main list.
+ - arc: adaptive replacement cache. Blocks seen once and blocks seen more than
+   once are kept on separate lists, with remembered evictions from each moving
+   the split between them. Scan resistant, and adapts to the workload.
+ Hits() and Misses() count Find() calls, so the policies can be compared.
+ Evictions() and PrefetchHits() show whether the cache is too small, and whether
+ blocks loaded ahead of use (see Prefetched()) are worth it.
+
+ Every operation is O(1) whatever the slot count:
+ - block number -> slot is a hash index,
+ - the lists are doubly linked, threaded through the slot table,
+ - free slots are a stack.
+ Eviction skips pinned slots, so it costs one step per pinned slot at the old end
+ of a list. clock also steps over flagged slots, at most twice round.
+
+ The slot memory is one allocation of slotCount x blockSize bytes, made in the
+ constructor. twoQ and arc keep the evicted block numbers they remember in their
+ own lists, of up to slotCount entries.
+
+ The allocation is page aligned. When blockSize is a multiple of PageSize() every
+ slot is page aligned, as O_DIRECT reads need.
+
+ A mapped cache only reserves the address range. Each slot is filled by mapping a
+ window of a file over it (see MapFile()), so the data stays in the kernel's page
+ cache and is not copied. Freed slots are unmapped, and a reused slot's old window
+ is replaced by the new one. blockSize must be a multiple of PageSize().
+
+ Not thread safe. The caller locks around every call. The one exception is the
+ slot tag (see Tag()), which can be read without the lock to check that a slot
+ pointer obtained earlier still holds the same block.
+*/
+
+class ABlockCache {
+public:
+	enum class Policy { lru, clock, twoQ, arc };
+private:
+	// Slot lists. lru and clock only use mainList.
+	// twoQ: probationList is A1in, mainList is Am. arc: probationList is T1, mainList is T2.
+	enum { mainList = 0, probationList = 1, listCount = 2 };
+
+	// Slot table entry. Links are slot indices. Index slotCount + n is the head of
+	// list n, whose next is the newest slot and prev the oldest.
+	struct Slot {
+		uint64_t block;
+		uint64_t prev;
+		uint64_t next;
+		uint8_t list;
+		// clock: hit since the hand last passed.
+		bool referenced;
+		// Loaded ahead of use and not yet found.
+		bool prefetched;
+	};
+
+	// Blocks of each group, see GroupBy(). Empty groups are erased.
+	typedef std::unordered_map<uint64_t, std::unordered_set<uint64_t>> GroupIndex;
+
+	// Evicted block numbers, newest first.
+	struct Ghosts {
+		std::list<uint64_t> order;
+		std::unordered_map<uint64_t, std::list<uint64_t>::iterator> index;
+		// As the cache's.
+		unsigned groupBits;
+		GroupIndex groups;
+
+		Ghosts() : groupBits(0) {}
+		uint64_t Size() const { return order.size(); }
+		bool Contains(uint64_t block) const { return index.find(block) != index.end(); }
+		void Add(uint64_t block);
+		void Remove(uint64_t block);
+		void DropOldest();
+		void Clear();
+		void RemoveGroup(uint64_t group);
+	};
+
+	uint64_t blockSize;
+	uint64_t slotCount;
+	Policy policy;
+	uint8_t* memory;
+	// See class comment.
+	bool mapped;
+	// Replace a mapped slot's window with inaccessible memory.
+	void Unmap(uint64_t slot);
+
+	// 0 if blocks are not grouped.
+	unsigned groupBits;
+	// Blocks held, by group.
+	GroupIndex groups;
+	static void Grouped(GroupIndex& groups, unsigned bits, uint64_t block, bool add);
+
+	std::vector<Slot> slots;
+	std::unordered_map<uint64_t, uint64_t> index;
+	std::vector<uint64_t> freeSlots;
+	uint64_t listSize[listCount];
+
+	// twoQ: [0] is A1out. arc: [0] is B1, [1] is B2.
+	Ghosts ghosts[2];
+	// arc: target size of probationList.
+	uint64_t target;
+
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	uint64_t prefetchHits;
+
+	// Per slot. block + 1 while the slot holds block's data, 0 while empty or being filled.
+	std::unique_ptr<std::atomic<uint64_t>[]> tags;
+
+	// Per slot pin counts. A pinned slot is never evicted or reused.
+	std::unique_ptr<std::atomic<uint32_t>[]> pins;
+	// Slots dropped by Clear() or Remove() while pinned. Freed when unpinned.
+	std::vector<uint64_t> orphans;
+	void ReclaimOrphans();
+
+	uint64_t SlotOf(const uint8_t* ptr) const { return (ptr - memory) / blockSize; }
+
+	static const uint64_t noSlot = UINT64_MAX;
+
+	uint64_t Head(unsigned list) const { return slotCount + list; }
+	void Unlink(uint64_t slot);
+	// Link as newest of list.
+	void LinkFront(uint64_t slot, unsigned list);
+
+	// A hit on slot.
+	void Touch(uint64_t slot);
+	// Oldest unpinned slot of list, or noSlot.
+	uint64_t Oldest(unsigned list) const;
+	// Slot to evict to make room for block, or noSlot if all are pinned.
+	uint64_t Victim(uint64_t block);
+	void Evict(uint64_t slot);
+	// Forget the oldest evictions beyond what the policy remembers.
+	void TrimGhosts();
+public:
+	// Throws ABinaryFile::ABinaryFileEx if the memory can not be allocated, or if mapped
+	// and blockSize is not a multiple of PageSize().
+	ABlockCache(uint64_t blockSize, uint64_t slotCount, Policy policy = Policy::lru, bool mapped = false);
+	ABlockCache(const ABlockCache&) = delete;
+	ABlockCache& operator=(const ABlockCache&) = delete;
+	~ABlockCache();
+
+	// Memory page size.
+	static uint64_t PageSize();
+
+	uint64_t BlockSize() const { return blockSize; }
+	uint64_t Capacity() const { return slotCount; }
+	Policy EvictionPolicy() const { return policy; }
+	bool Mapped() const { return mapped; }
+	// Blocks held.
+	uint64_t Count() const { return index.size(); }
+
+	// Slot holding block, which counts as a hit for the policy. nullptr if absent.
+	// Counted in Hits() or Misses().
+	uint8_t* Find(uint64_t block);
+
+	// As Find() but not a hit, and not counted.
+	const uint8_t* Peek(uint64_t block) const;
+
+	bool Contains(uint64_t block) const;
+
+	// Give block a slot, evicting an unpinned block, as the policy chooses, if full.
+	// Returns nullptr if every slot is pinned.
+	// The slot contents are whatever was there before. The caller fills it and
+	// then calls Filled().
+	// evicted is set to the evicted block number, or -1.
+	// If block is already held, its slot is returned (as a hit, but not counted) and
+	// nothing is evicted.
+	uint8_t* Insert(uint64_t block, int64_t& evicted);
+
+	// The slot returned by Insert() now holds its block's data.
+	void Filled(const uint8_t* slot);
+
+	// Mapped caches. Map blockSize bytes of desc from offset, which must be page aligned,
+	// read only over the slot returned by Insert(). Then call Filled().
+	// Returns false, with errno set and the slot unmapped, if mmap() fails.
+	bool MapFile(const uint8_t* slot, int desc, uint64_t offset);
+
+	// The filled slot at ptr was loaded ahead of use. Its first Find() counts in
+	// PrefetchHits().
+	void Prefetched(const uint8_t* slot) { slots[SlotOf(slot)].prefetched = true; }
+
+	// Tag of the slot at ptr. A reader without the lock can use a slot pointer as
+	// long as the tag is block + 1 both before and after the read (a seqlock).
+	const std::atomic<uint64_t>& Tag(const uint8_t* slot) const { return tags[SlotOf(slot)]; }
+
+	// Pin the slot at ptr, which must hold a block. Called with the lock held.
+	void Pin(const uint8_t* slot) { pins[SlotOf(slot)].fetch_add(1, std::memory_order_relaxed); }
+
+	// Pin count of the slot at ptr. Unpinning is a decrement of this and does not
+	// need the lock.
+	std::atomic<uint32_t>& PinCount(const uint8_t* slot) { return pins[SlotOf(slot)]; }
+	// True if any slot, found or orphaned, is pinned. O(slotCount).
+	bool AnyPinned() const;
+
+	// Free block's slot. Does nothing if absent.
+	// A pinned slot is only freed once unpinned.
+	void Remove(uint64_t block);
+
+	// Keep an index of blocks, held and remembered, by block >> bits, for RemoveGroup().
+	// Call before the first Insert().
+	void GroupBy(unsigned bits) { groupBits = bits; for (Ghosts& G : ghosts) { G.groupBits = bits; } }
+	// Remove() every block of group, and forget its remembered evictions. Costs the
+	// group's blocks, not the whole cache.
+	void RemoveGroup(uint64_t group);
+
+	// Free all slots, and forget remembered evictions. zero also clears the slot memory.
+	// Pinned slots keep their data until unpinned, but are no longer found by Find().
+	void Clear(bool zero = false);
+
+	// Blocks held, next to be evicted first (roughly, for clock, twoQ and arc).
+	std::vector<uint64_t> Blocks() const;
+
+	uint64_t Hits() const { return hits; }
+	uint64_t Misses() const { return misses; }
+	// Hits / (Hits + Misses). 0 if there have been no Find() calls.
+	double HitRatio() const;
+	// Blocks evicted by Insert().
+	uint64_t Evictions() const { return evictions; }
+	// Prefetched blocks that have since been found.
+	uint64_t PrefetchHits() const { return prefetchHits; }
+	void ResetCounts() { hits = misses = evictions = prefetchHits = 0; }
+};
+
+/*
+ How ABigBinaryFile uses the cache.
+
+ ThreadMode::single has one ABlockCache and no lock. ThreadMode::concurrent splits the
+ blocks over shards (ABlockCacheShard), each with its own lock. Each thread remembers
+ the last block it read and reads it again without the lock, checking the slot tag
+ either side of the read. Reset(), FileCheck(), the Set...() calls and assignment are
+ never thread safe.
+
+ SetReadahead() starts a thread that loads blocks ahead of each reading thread. Moves
+ between blocks, by operator[], Pin() or the iterators, are watched, and after two in a
+ row with the same stride the next blocks along it are queued. LoadBlocksAsync() reads
+ through an AsyncBlockLoader. Either makes the cache locked as in concurrent mode.
+
+ PinnedBlock, the iterators, blocks changed by Write() and slots LoadBlocksAsync() is
+ reading into are pinned. Write() and LoadBlocksAsync() pin at most half of a shard's
+ slots, so readers of the shard still find one.
+
+ With an ASharedBlockCache the shards are the shared cache's, and keys carry the owner.
+ A mapped cache (SetMapped()) is never locked for threads, as a window can be unmapped
+ while a reader without the lock is in it. Shrinking the file under a mapped block
+ makes reading it raise SIGBUS.
+*/
+
+// An ABlockCache and the lock around it.
+struct ABlockCacheShard {
+	std::mutex lock;
+	std::unique_ptr<ABlockCache> cache;
+	// Notified, with lock held, when a slot filled outside lock is done with.
+	std::condition_variable_any filled;
+};
+
+/*
+ Block cache shared by any number of ABigBinaryFile and ABigTextFile instances, within
+ one memory budget. Blocks are kept by (file, block) in one set of shards with one
+ eviction policy, so the files in use get the memory and idle files give it up.
+ Global() is a process wide one.
+
+ Each instance using it takes an owner number, which is the top bits of its block
+ keys (see Key()). So up to maxOwners instances at once, of up to 2^blockBits blocks.
+ Owner 0 is never given out. Key(0, block) == block, as in a cache of one's own.
+
+ Thread safe.
+*/
+
+class ASharedBlockCache {
+	uint64_t blockSize;
+	uint64_t slotCount;
+	ABlockCache::Policy policy;
+	std::unique_ptr<ABlockCacheShard[]> shards;
+	unsigned shardCount;
+
+	std::mutex ownerLock;
+	std::vector<uint32_t> freeOwners;
+	uint32_t nextOwner;
+public:
+	static const unsigned blockBits = 44;
+	static const uint32_t maxOwners = (1U << (64 - blockBits)) - 1;
+
+	// budget is in bytes. shardCount 0 is 4 per hardware thread.
+	// Throws ABinaryFile::ABinaryFileEx if budget is less than a block or the memory
+	// can not be allocated.
+	ASharedBlockCache(uint64_t blockSize, uint64_t budget, ABlockCache::Policy policy = ABlockCache::Policy::lru,
+					  unsigned shardCount = 0);
+	ASharedBlockCache(const ASharedBlockCache&) = delete;
+	ASharedBlockCache& operator=(const ASharedBlockCache&) = delete;
+
+	uint64_t BlockSize() const { return blockSize; }
+	// In blocks.
+	uint64_t Capacity() const { return slotCount; }
+	ABlockCache::Policy EvictionPolicy() const { return policy; }
+
+	// Block key k lives in Shards()[n % ShardCount()], where n is chosen by the user.
+	ABlockCacheShard* Shards() const { return shards.get(); }
+	unsigned ShardCount() const { return shardCount; }
+
+	static uint64_t Key(uint32_t owner, uint64_t block) { return ((uint64_t)owner << blockBits) | block; }
+	static uint32_t OwnerOf(uint64_t key) { return (uint32_t)(key >> blockBits); }
+	static uint64_t BlockOf(uint64_t key) { return key & ((1ULL << blockBits) - 1); }
+
+	// A new owner number. Throws ABinaryFile::ABinaryFileEx if all are in use.
+	uint32_t Join();
+	// Drop owner's blocks and free its number.
+	void Leave(uint32_t owner);
+	// Drop owner's blocks, and forget its evicted blocks so an owner number given out
+	// again starts clean. Costs owner's blocks, not the whole cache.
+	void Purge(uint32_t owner);
+
+	// The process wide cache. Made by the last ConfigureGlobal(), or with 64KB blocks
+	// and a 256MB budget on first use if there was none.
+	static std::shared_ptr<ASharedBlockCache> Global();
+	// Replace the process wide cache. Instances using the old one keep it until they go.
+	// Throws as the constructor.
+	static std::shared_ptr<ASharedBlockCache> ConfigureGlobal(uint64_t blockSize, uint64_t budget,
+					ABlockCache::Policy policy = ABlockCache::Policy::lru);
+};
+
+#endif /* BlockCache_hpp */
@@ -0,0 +1,155 @@
+//
+//  ByteOrder.cpp
+//  CPP-Utilities
+//
+//  Created by agent on 17/10/26.
+//  Copyright © 2026 tridiak. All rights reserved.
+//
+
+#include "ByteOrder.hpp"
+
+#if defined(__SSSE3__)
+	#include <tmmintrin.h>
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+	#include <arm_neon.h>
+#endif
+
+using namespace ByteOrder;
+
+// Bytes per vector iteration.
+#define VectorBytes 16
+
+//----
+// Scalar tails. Also the whole job when there is no vector unit.
+
+template<class T> static void SwapCopyScalar(uint8_t* dest, const uint8_t* src, uint64_t count) {
+	for (uint64_t t = 0; t < count; t++) {
+		T v;
+		memcpy(&v, src + t * sizeof(T), sizeof(T));
+		v = Swap(v);
+		memcpy(dest + t * sizeof(T), &v, sizeof(T));
+	}
+};
+
+//----
+
+void ByteOrder::SwapCopy16(void* dest, const void* src, uint64_t count) {
+	uint8_t* D = (uint8_t*)dest;
+	const uint8_t* S = (const uint8_t*)src;
+	uint64_t vectors = count * 2 / VectorBytes;
+
+#if defined(__SSSE3__)
+	const __m128i mask = _mm_setr_epi8(1,0, 3,2, 5,4, 7,6, 9,8, 11,10, 13,12, 15,14);
+	for (uint64_t t = 0; t < vectors; t++) {
+		__m128i v = _mm_loadu_si128((const __m128i*)S);
+		_mm_storeu_si128((__m128i*)D, _mm_shuffle_epi8(v, mask));
+		S += VectorBytes; D += VectorBytes;
+	}
+#elif defined(__SSE2__)
+	for (uint64_t t = 0; t < vectors; t++) {
+		__m128i v = _mm_loadu_si128((const __m128i*)S);
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		_mm_storeu_si128((__m128i*)D, v);
+		S += VectorBytes; D += VectorBytes;
+	}
+#elif defined(__ARM_NEON)
+	for (uint64_t t = 0; t < vectors; t++) {
+		vst1q_u8(D, vrev16q_u8(vld1q_u8(S)));
+		S += VectorBytes; D += VectorBytes;
+	}
+#else
+	vectors = 0;
+#endif
+
+	SwapCopyScalar<uint16_t>(D, S, count - vectors * VectorBytes / 2);
+};
+
+//----
+
+void ByteOrder::SwapCopy32(void* dest, const void* src, uint64_t count) {
+	uint8_t* D = (uint8_t*)dest;
+	const uint8_t* S = (const uint8_t*)src;
+	uint64_t vectors = count * 4 / VectorBytes;
+
+#if defined(__SSSE3__)
+	const __m128i mask = _mm_setr_epi8(3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12);
+	for (uint64_t t = 0; t < vectors; t++) {
+		__m128i v = _mm_loadu_si128((const __m128i*)S);
+		_mm_storeu_si128((__m128i*)D, _mm_shuffle_epi8(v, mask));
+		S += VectorBytes; D += VectorBytes;
+	}
+#elif defined(__SSE2__)
+	for (uint64_t t = 0; t < vectors; t++) {
+		__m128i v = _mm_loadu_si128((const __m128i*)S);
+		// Swap bytes in each 16 bit word, then swap the words in each 32 bit value.
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		_mm_storeu_si128((__m128i*)D, v);
+		S += VectorBytes; D += VectorBytes;
+	}
+#elif defined(__ARM_NEON)
+	for (uint64_t t = 0; t < vectors; t++) {
+		vst1q_u8(D, vrev32q_u8(vld1q_u8(S)));
+		S += VectorBytes; D += VectorBytes;
+	}
+#else
+	vectors = 0;
+#endif
+
+	SwapCopyScalar<uint32_t>(D, S, count - vectors * VectorBytes / 4);
+};
+
+//----
+
+void ByteOrder::SwapCopy64(void* dest, const void* src, uint64_t count) {
+	uint8_t* D = (uint8_t*)dest;
+	const uint8_t* S = (const uint8_t*)src;
+	uint64_t vectors = count * 8 / VectorBytes;
+
+#if defined(__SSSE3__)
+	const __m128i mask = _mm_setr_epi8(7,6,5,4,3,2,1,0, 15,14,13,12,11,10,9,8);
+	for (uint64_t t = 0; t < vectors; t++) {
+		__m128i v = _mm_loadu_si128((const __m128i*)S);
+		_mm_storeu_si128((__m128i*)D, _mm_shuffle_epi8(v, mask));
+		S += VectorBytes; D += VectorBytes;
+	}
+#elif defined(__SSE2__)
+	for (uint64_t t = 0; t < vectors; t++) {
+		__m128i v = _mm_loadu_si128((const __m128i*)S);
+		// Swap bytes in each 16 bit word, then reverse the words in each 64 bit value.
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+		v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+		_mm_storeu_si128((__m128i*)D, v);
+		S += VectorBytes; D += VectorBytes;
+	}
+#elif defined(__ARM_NEON)
+	for (uint64_t t = 0; t < vectors; t++) {
+		vst1q_u8(D, vrev64q_u8(vld1q_u8(S)));
+		S += VectorBytes; D += VectorBytes;
+	}
+#else
+	vectors = 0;
+#endif
+
+	SwapCopyScalar<uint64_t>(D, S, count - vectors * VectorBytes / 8);
+};
+
+//----
+
+void ByteOrder::Decode(void* dest, const void* src, uint64_t count, unsigned width, Endian order) {
+	if (width == 1 || order == HostEndian()) {
+		memcpy(dest, src, count * width);
+		return;
+	}
+
+	switch (width) {
+		case 2: SwapCopy16(dest, src, count); break;
+		case 4: SwapCopy32(dest, src, count); break;
+		case 8: SwapCopy64(dest, src, count); break;
+		default: break;
+	}
+};
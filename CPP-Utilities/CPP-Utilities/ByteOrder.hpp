@@ -0,0 +1,66 @@
+//
+//  ByteOrder.hpp
+//  CPP-Utilities
+//
+//  Created by agent on 17/10/26.
+//  Copyright © 2026 tridiak. All rights reserved.
+//
+
+#ifndef ByteOrder_hpp
+#define ByteOrder_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+namespace ByteOrder {
+
+enum class Endian { little, big };
+
+// Byte order of the machine we are running on.
+inline Endian HostEndian() {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	return Endian::big;
+#else
+	return Endian::little;
+#endif
+};
+
+inline uint8_t Swap(uint8_t v) { return v; };
+inline uint16_t Swap(uint16_t v) { return __builtin_bswap16(v); };
+inline uint32_t Swap(uint32_t v) { return __builtin_bswap32(v); };
+inline uint64_t Swap(uint64_t v) { return __builtin_bswap64(v); };
+
+// Read a T stored in the given byte order. src does not need to be aligned.
+// T can be any integer type, float or double.
+template<class T> T Load(const void* src, Endian order) {
+	static_assert(std::is_arithmetic<T>::value, "Load() is for integer and floating point types");
+	typedef typename std::conditional<sizeof(T) == 1, uint8_t,
+			typename std::conditional<sizeof(T) == 2, uint16_t,
+			typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type>::type>::type Raw;
+	static_assert(sizeof(Raw) == sizeof(T), "Unsupported size");
+
+	Raw raw;
+	memcpy(&raw, src, sizeof(raw));
+	if (order != HostEndian()) { raw = Swap(raw); }
+
+	T v;
+	memcpy(&v, &raw, sizeof(v));
+	return v;
+};
+
+// Copy count values of 2, 4 or 8 bytes from src to dest, reversing the bytes
+// of each value. Neither pointer needs to be aligned. Buffers must not overlap.
+// Uses SSE2/SSSE3 or NEON when the compiler targets them.
+void SwapCopy16(void* dest, const void* src, uint64_t count);
+void SwapCopy32(void* dest, const void* src, uint64_t count);
+void SwapCopy64(void* dest, const void* src, uint64_t count);
+
+// Copy count values of width bytes (1, 2, 4 or 8) stored in the given order
+// into dest in host order. A straight memcpy if no swapping is needed.
+void Decode(void* dest, const void* src, uint64_t count, unsigned width, Endian order);
+
+}; // namespace
+
+#endif /* ByteOrder_hpp */
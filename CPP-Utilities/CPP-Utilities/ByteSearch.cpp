@@ -0,0 +1,326 @@
+//
+//  ByteSearch.cpp
+//  CPP-Utilities
+//
+//  Created by agent on 17/10/26.
+//  Copyright © 2026 tridiak. All rights reserved.
+//
+
+#include "ByteSearch.hpp"
+#include <string.h>
+#include <deque>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+	#include <arm_neon.h>
+#endif
+
+// AVX2 functions are built for it whatever the compiler flags, and only called if the
+// CPU has it.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+	#define UseAVX2 1
+	#include <immintrin.h>
+#endif
+
+using namespace ByteSearch;
+
+// Marks a missing trie edge while the automaton is built.
+#define NoState UINT32_MAX
+
+//---------------------------------------------------------------
+#pragma mark Single pattern
+
+// memchr() for the first byte, memcmp() for the rest. Starts at position start.
+static int64_t FindScalar(const uint8_t* d, uint64_t n, const uint8_t* pat, uint64_t m, uint64_t start) {
+	uint64_t t = start;
+	while (t + m <= n) {
+		const uint8_t* p = (const uint8_t*)memchr(d + t, pat[0], n - m + 1 - t);
+		if (!p) { return -1; }
+		t = p - d;
+		if (memcmp(p + 1, pat + 1, m - 1) == 0) { return t; }
+		t++;
+	}
+	return -1;
+};
+
+//----
+
+int64_t ByteSearch::Find(const void* data, uint64_t len, const void* pattern, uint64_t patLen) {
+	const uint8_t* d = (const uint8_t*)data;
+	const uint8_t* pat = (const uint8_t*)pattern;
+	uint64_t m = patLen;
+
+	if (m == 0 || m > len) { return -1; }
+	// memchr() is already vectorised.
+	if (m == 1) {
+		const uint8_t* p = (const uint8_t*)memchr(d, pat[0], len);
+		return p ? p - d : -1;
+	}
+
+	uint64_t t = 0;
+	// Test 16 positions at once. A position is a candidate if both the first and last
+	// bytes of the pattern match there. Loads stay inside data.
+#if defined(__SSE2__)
+	const __m128i first = _mm_set1_epi8((char)pat[0]);
+	const __m128i last = _mm_set1_epi8((char)pat[m - 1]);
+	for (; t + m - 1 + 16 <= len; t += 16) {
+		__m128i A = _mm_loadu_si128((const __m128i*)(d + t));
+		__m128i B = _mm_loadu_si128((const __m128i*)(d + t + m - 1));
+		unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(A, first), _mm_cmpeq_epi8(B, last)));
+		while (mask) {
+			unsigned bit = __builtin_ctz(mask);
+			if (memcmp(d + t + bit + 1, pat + 1, m - 2) == 0) { return t + bit; }
+			mask &= mask - 1;
+		}
+	}
+#elif defined(__ARM_NEON)
+	const uint8x16_t first = vdupq_n_u8(pat[0]);
+	const uint8x16_t last = vdupq_n_u8(pat[m - 1]);
+	for (; t + m - 1 + 16 <= len; t += 16) {
+		uint8x16_t eq = vandq_u8(vceqq_u8(vld1q_u8(d + t), first), vceqq_u8(vld1q_u8(d + t + m - 1), last));
+		// Narrow to 4 bits per byte so the result fits in 64 bits.
+		uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+		while (mask) {
+			unsigned bit = __builtin_ctzll(mask) / 4;
+			if (memcmp(d + t + bit + 1, pat + 1, m - 2) == 0) { return t + bit; }
+			mask &= ~(0xFULL << (bit * 4));
+		}
+	}
+#endif
+
+	return FindScalar(d, len, pat, m, t);
+};
+
+//----
+
+void ByteSearch::FindAll(const void* data, uint64_t len, const void* pattern, uint64_t patLen,
+			std::vector<uint64_t>& found, uint64_t base) {
+	const uint8_t* d = (const uint8_t*)data;
+	uint64_t start = 0;
+	while (start < len) {
+		int64_t pos = Find(d + start, len - start, pattern, patLen);
+		if (pos < 0) { return; }
+		found.push_back(base + start + pos);
+		start += pos + 1;
+	}
+};
+
+uint64_t ByteSearch::Count(const void* data, uint64_t len, const void* pattern, uint64_t patLen) {
+	const uint8_t* d = (const uint8_t*)data;
+	uint64_t count = 0;
+	uint64_t start = 0;
+	while (start < len) {
+		int64_t pos = Find(d + start, len - start, pattern, patLen);
+		if (pos < 0) { break; }
+		count++;
+		start += pos + 1;
+	}
+	return count;
+};
+
+//---------------------------------------------------------------
+#pragma mark - Line feeds
+
+// Append base + the position of each set bit of mask to found.
+static inline void AddBits(uint64_t mask, uint64_t base, std::vector<uint64_t>& found) {
+	while (mask) {
+		found.push_back(base + __builtin_ctzll(mask));
+		mask &= mask - 1;
+	}
+};
+
+// Vector scans for byte a, or with pair for a followed by b, from position 0. Each returns
+// the position it stopped at, leaving the rest to LinesScalar(). Loads stay inside d.
+typedef uint64_t (*LineScan)(const uint8_t* d, uint64_t n, uint8_t a, uint8_t b, bool pair,
+			std::vector<uint64_t>& found, uint64_t base);
+
+#ifdef UseAVX2
+__attribute__((target("avx2")))
+static uint64_t LinesAVX2(const uint8_t* d, uint64_t n, uint8_t a, uint8_t b, bool pair,
+			std::vector<uint64_t>& found, uint64_t base) {
+	const __m256i A = _mm256_set1_epi8((char)a);
+	const __m256i B = _mm256_set1_epi8((char)b);
+	uint64_t t = 0;
+	for (; t + 32 + pair <= n; t += 32) {
+		__m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(d + t)), A);
+		if (pair) { eq = _mm256_and_si256(eq, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(d + t + 1)), B)); }
+		AddBits((uint32_t)_mm256_movemask_epi8(eq), base + t, found);
+	}
+	return t;
+};
+#endif
+
+#if defined(__SSE2__)
+static uint64_t LinesSSE2(const uint8_t* d, uint64_t n, uint8_t a, uint8_t b, bool pair,
+			std::vector<uint64_t>& found, uint64_t base) {
+	const __m128i A = _mm_set1_epi8((char)a);
+	const __m128i B = _mm_set1_epi8((char)b);
+	uint64_t t = 0;
+	for (; t + 16 + pair <= n; t += 16) {
+		__m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(d + t)), A);
+		if (pair) { eq = _mm_and_si128(eq, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(d + t + 1)), B)); }
+		AddBits((unsigned)_mm_movemask_epi8(eq), base + t, found);
+	}
+	return t;
+};
+#elif defined(__ARM_NEON)
+static uint64_t LinesNEON(const uint8_t* d, uint64_t n, uint8_t a, uint8_t b, bool pair,
+			std::vector<uint64_t>& found, uint64_t base) {
+	const uint8x16_t A = vdupq_n_u8(a);
+	const uint8x16_t B = vdupq_n_u8(b);
+	uint64_t t = 0;
+	for (; t + 16 + pair <= n; t += 16) {
+		uint8x16_t eq = vceqq_u8(vld1q_u8(d + t), A);
+		if (pair) { eq = vandq_u8(eq, vceqq_u8(vld1q_u8(d + t + 1), B)); }
+		// 4 bits per byte, as in Find().
+		uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+		while (mask) {
+			unsigned bit = __builtin_ctzll(mask) / 4;
+			found.push_back(base + t + bit);
+			mask &= ~(0xFULL << (bit * 4));
+		}
+	}
+	return t;
+};
+#endif
+
+static LineScan PickLineScan() {
+#ifdef UseAVX2
+	if (__builtin_cpu_supports("avx2")) { return LinesAVX2; }
+#endif
+#if defined(__SSE2__)
+	return LinesSSE2;
+#elif defined(__ARM_NEON)
+	return LinesNEON;
+#else
+	return nullptr;
+#endif
+};
+
+static void Lines(const uint8_t* d, uint64_t n, uint8_t a, uint8_t b, bool pair,
+			std::vector<uint64_t>& found, uint64_t base) {
+	static const LineScan scan = PickLineScan();
+	uint64_t t = scan ? scan(d, n, a, b, pair, found, base) : 0;
+	for (; t < n; t++) {
+		if (d[t] == a && (!pair || (t + 1 < n && d[t + 1] == b))) { found.push_back(base + t); }
+	}
+};
+
+//----
+
+void ByteSearch::FindAllByte(const void* data, uint64_t len, uint8_t c, std::vector<uint64_t>& found, uint64_t base) {
+	Lines((const uint8_t*)data, len, c, 0, false, found, base);
+};
+
+void ByteSearch::FindAllCRLF(const void* data, uint64_t len, std::vector<uint64_t>& found, uint64_t base, bool& cr) {
+	if (len == 0) { return; }
+	const uint8_t* d = (const uint8_t*)data;
+	if (cr && d[0] == 10) { found.push_back(base - 1); }
+	Lines(d, len, 13, 10, true, found, base);
+	cr = d[len - 1] == 13;
+};
+
+//---------------------------------------------------------------
+#pragma mark - MultiPattern
+
+MultiPattern::MultiPattern() {
+	built = false;
+};
+
+MultiPattern::MultiPattern(const std::vector<std::string>& patterns) : MultiPattern() {
+	for (const std::string& s : patterns) { Add(s); }
+};
+
+uint32_t MultiPattern::Add(const void* pattern, uint64_t len) {
+	if (len == 0) { return UINT32_MAX; }
+	patterns.push_back(std::string((const char*)pattern, len));
+	built = false;
+	return (uint32_t)patterns.size() - 1;
+};
+
+uint32_t MultiPattern::Add(const std::string& pattern) {
+	return Add(pattern.data(), pattern.size());
+};
+
+//----
+
+void MultiPattern::Build() {
+	next.assign(256, NoState);
+	terminals.assign(1, std::vector<uint32_t>());
+
+	// Trie
+	for (uint32_t p = 0; p < patterns.size(); p++) {
+		uint32_t state = 0;
+		for (unsigned char c : patterns[p]) {
+			uint32_t& edge = next[state * 256 + c];
+			if (edge == NoState) {
+				edge = (uint32_t)terminals.size();
+				terminals.push_back(std::vector<uint32_t>());
+				next.resize(next.size() + 256, NoState);
+			}
+			// Re-read, resize() may have moved the table.
+			state = next[state * 256 + c];
+		}
+		terminals[state].push_back(p);
+	}
+
+	// Breadth first, filling the missing edges from the failure state.
+	size_t stateCount = terminals.size();
+	std::vector<uint32_t> fail(stateCount, 0);
+	outputLink.assign(stateCount, 0);
+	std::deque<uint32_t> queue;
+
+	for (int c = 0; c < 256; c++) {
+		uint32_t& edge = next[c];
+		if (edge == NoState) { edge = 0; }
+		else { queue.push_back(edge); }
+	}
+
+	while (!queue.empty()) {
+		uint32_t state = queue.front();
+		queue.pop_front();
+
+		for (int c = 0; c < 256; c++) {
+			uint32_t& edge = next[state * 256 + c];
+			uint32_t viaFail = next[fail[state] * 256 + c];
+			if (edge == NoState) {
+				edge = viaFail;
+				continue;
+			}
+			uint32_t child = edge;
+			fail[child] = viaFail;
+			outputLink[child] = terminals[viaFail].empty() ? outputLink[viaFail] : viaFail;
+			queue.push_back(child);
+		}
+	}
+
+	built = true;
+};
+
+//----
+
+MultiPattern::State MultiPattern::Scan(State state, const void* data, uint64_t len, uint64_t base, std::vector<Match>& found) {
+	if (!built) { Build(); }
+
+	const uint8_t* d = (const uint8_t*)data;
+	const uint32_t* table = next.data();
+	for (uint64_t t = 0; t < len; t++) {
+		state = table[state * 256 + d[t]];
+		if (terminals[state].empty() && outputLink[state] == 0) { continue; }
+
+		// Every pattern ending here. Own patterns, then those down the output chain.
+		for (uint32_t s = state; s != 0; s = outputLink[s]) {
+			for (uint32_t p : terminals[s]) {
+				found.push_back({base + t + 1 - patterns[p].size(), p});
+			}
+		}
+	}
+	return state;
+};
+
+std::vector<Match> MultiPattern::FindAll(const void* data, uint64_t len) {
+	std::vector<Match> found;
+	Scan(Start(), data, len, 0, found);
+	return found;
+};
@@ -0,0 +1,110 @@
+//
+//  ByteSearch.hpp
+//  CPP-Utilities
+//
+//  Created by agent on 17/10/26.
+//  Copyright © 2026 tridiak. All rights reserved.
+//
+
+#ifndef ByteSearch_hpp
+#define ByteSearch_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ Byte pattern search.
+
+ Single patterns use SSE2 or NEON to test 16 candidate positions at a time,
+ matching the first and last byte of the pattern before comparing the rest.
+ Without a vector unit it falls back to memchr() + memcmp().
+
+ Line feed scans test 32 bytes at a time with AVX2 where the CPU has it, chosen when
+ first called, else 16 with SSE2 or NEON, else a byte at a time. A CR LF pair split
+ between two pieces of a scan is still found.
+
+ MultiPattern is an Aho-Corasick automaton. All patterns are found in one pass
+ whatever their number. Scans can be fed in pieces, so matches that span
+ pieces are still found.
+
+ Matches can overlap: "aa" is found twice in "aaa".
+*/
+
+namespace ByteSearch {
+
+// Position of the first occurrence of pattern in data, or -1.
+// An empty pattern is never found.
+int64_t Find(const void* data, uint64_t len, const void* pattern, uint64_t patLen);
+
+// Append position + base of every occurrence to found.
+void FindAll(const void* data, uint64_t len, const void* pattern, uint64_t patLen,
+			std::vector<uint64_t>& found, uint64_t base = 0);
+
+// Number of occurrences.
+uint64_t Count(const void* data, uint64_t len, const void* pattern, uint64_t patLen);
+
+//------------------------------------------
+// Line feeds
+
+// Append position + base of every byte c in data to found. c is 10 for unix line
+// feeds, 13 for classic Mac.
+void FindAllByte(const void* data, uint64_t len, uint8_t c, std::vector<uint64_t>& found, uint64_t base = 0);
+
+// Append position + base of the CR of every CR LF pair in data to found.
+// cr is whether the piece before ended with a CR, false to start. It is set for the
+// next piece, whose LF at position 0 makes a pair found at base - 1.
+void FindAllCRLF(const void* data, uint64_t len, std::vector<uint64_t>& found, uint64_t base, bool& cr);
+
+//------------------------------------------
+
+// Match from a MultiPattern search.
+struct Match {
+	// Position of the first byte of the match.
+	uint64_t pos;
+	// Index returned by MultiPattern::Add().
+	uint32_t pattern;
+};
+
+class MultiPattern {
+	// Full transition table, 256 entries per state. Failure links are folded in,
+	// so each input byte costs one lookup.
+	std::vector<uint32_t> next;
+	// Patterns ending at each state.
+	std::vector<std::vector<uint32_t>> terminals;
+	// Nearest state down the failure chain that has terminals. 0 if none.
+	std::vector<uint32_t> outputLink;
+	std::vector<std::string> patterns;
+	bool built;
+
+	void Build();
+public:
+	typedef uint32_t State;
+
+	MultiPattern();
+	MultiPattern(const std::vector<std::string>& patterns);
+
+	// Returns the pattern's index. Empty patterns are ignored and return UINT32_MAX.
+	// Adding after a scan rebuilds the automaton on the next scan.
+	uint32_t Add(const void* pattern, uint64_t len);
+	uint32_t Add(const std::string& pattern);
+
+	size_t PatternCount() const { return patterns.size(); }
+	uint64_t PatternLength(uint32_t pattern) const { return patterns[pattern].size(); }
+
+	// State to start a scan with.
+	State Start() const { return 0; }
+
+	// Scan len bytes, appending matches to found. Returns the state to pass to the
+	// next call. base is the position of data[0] in the whole stream.
+	// Not const because the automaton is built on first use.
+	State Scan(State state, const void* data, uint64_t len, uint64_t base, std::vector<Match>& found);
+
+	// Scan a single block of data from the start state.
+	std::vector<Match> FindAll(const void* data, uint64_t len);
+};
+
+}; // namespace
+
+#endif /* ByteSearch_hpp */
@@ -0,0 +1,349 @@
+//
+//  Checksum.cpp
+//  CPP-Utilities
+//
+//  Created by agent on 17/10/26.
+//  Copyright © 2026 tridiak. All rights reserved.
+//
+
+#include "Checksum.hpp"
+#include "ByteOrder.hpp"
+#include "Debug.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <nmmintrin.h>
+	#define CRCX86 1
+#elif defined(__ARM_FEATURE_CRC32)
+	#include <arm_acle.h>
+	#define CRCARM 1
+#endif
+
+using namespace Checksum;
+
+// Reflected Castagnoli polynomial.
+#define CRC32CPoly 0x82F63B78
+
+//---------------------------------------------------------------
+#pragma mark CRC32C
+
+typedef uint32_t (*CRCEngine)(uint32_t crc, const uint8_t* p, size_t len);
+
+// Slicing-by-8 tables. Built once, on first use.
+struct CRCTable {
+	uint32_t t[8][256];
+
+	CRCTable() {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t crc = i;
+			for (int b = 0; b < 8; b++) {
+				crc = (crc & 1) ? (crc >> 1) ^ CRC32CPoly : crc >> 1;
+			}
+			t[0][i] = crc;
+		}
+		for (uint32_t i = 0; i < 256; i++) {
+			for (int k = 1; k < 8; k++) {
+				t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+			}
+		}
+	};
+};
+
+static uint32_t CRCSoftware(uint32_t crc, const uint8_t* p, size_t len) {
+	static const CRCTable table;
+	const uint32_t (*t)[256] = table.t;
+
+	while (len >= 8) {
+		uint32_t one = ByteOrder::Load<uint32_t>(p, ByteOrder::Endian::little) ^ crc;
+		uint32_t two = ByteOrder::Load<uint32_t>(p + 4, ByteOrder::Endian::little);
+		crc = t[7][one & 0xFF] ^ t[6][(one >> 8) & 0xFF] ^ t[5][(one >> 16) & 0xFF] ^ t[4][one >> 24]
+			^ t[3][two & 0xFF] ^ t[2][(two >> 8) & 0xFF] ^ t[1][(two >> 16) & 0xFF] ^ t[0][two >> 24];
+		p += 8;
+		len -= 8;
+	}
+	while (len--) {
+		crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+};
+
+#if CRCX86
+__attribute__((target("sse4.2")))
+static uint32_t CRCHardware(uint32_t crc, const uint8_t* p, size_t len) {
+	// Align so the wide loads do not straddle cache lines.
+	while (len > 0 && ((uintptr_t)p & 7)) {
+		crc = _mm_crc32_u8(crc, *p++);
+		len--;
+	}
+#if defined(__x86_64__)
+	while (len >= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		crc = (uint32_t)_mm_crc32_u64(crc, v);
+		p += 8;
+		len -= 8;
+	}
+#endif
+	while (len >= 4) {
+		uint32_t v;
+		memcpy(&v, p, 4);
+		crc = _mm_crc32_u32(crc, v);
+		p += 4;
+		len -= 4;
+	}
+	while (len--) {
+		crc = _mm_crc32_u8(crc, *p++);
+	}
+	return crc;
+};
+#elif CRCARM
+static uint32_t CRCHardware(uint32_t crc, const uint8_t* p, size_t len) {
+	while (len > 0 && ((uintptr_t)p & 7)) {
+		crc = __crc32cb(crc, *p++);
+		len--;
+	}
+	while (len >= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		crc = __crc32cd(crc, v);
+		p += 8;
+		len -= 8;
+	}
+	while (len--) {
+		crc = __crc32cb(crc, *p++);
+	}
+	return crc;
+};
+#endif
+
+static CRCEngine ChooseEngine() {
+#if CRCX86
+	if (__builtin_cpu_supports("sse4.2")) { return CRCHardware; }
+#elif CRCARM
+	return CRCHardware;
+#endif
+	return CRCSoftware;
+};
+
+static CRCEngine Engine() {
+	static const CRCEngine engine = ChooseEngine();
+	return engine;
+};
+
+//----
+
+void CRC32CState::Update(const void* data, size_t len) {
+	if (len == 0) { return; }
+	state = Engine()(state, (const uint8_t*)data, len);
+};
+
+bool Checksum::HardwareCRC32C() {
+	return Engine() != CRCSoftware;
+};
+
+//---------------------------------------------------------------
+#pragma mark - XXH64
+
+static const uint64_t Prime1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t Prime3 = 0x165667B19E3779F9ULL;
+static const uint64_t Prime4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t Prime5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t RotL(uint64_t v, int r) {
+	return (v << r) | (v >> (64 - r));
+};
+
+static inline uint64_t Round(uint64_t acc, uint64_t input) {
+	acc += input * Prime2;
+	acc = RotL(acc, 31);
+	return acc * Prime1;
+};
+
+static inline uint64_t MergeRound(uint64_t acc, uint64_t val) {
+	acc ^= Round(0, val);
+	return acc * Prime1 + Prime4;
+};
+
+static inline uint64_t Read64(const uint8_t* p) {
+	return ByteOrder::Load<uint64_t>(p, ByteOrder::Endian::little);
+};
+
+static inline uint32_t Read32(const uint8_t* p) {
+	return ByteOrder::Load<uint32_t>(p, ByteOrder::Endian::little);
+};
+
+//----
+
+void Hash64State::Reset() {
+	acc[0] = seed + Prime1 + Prime2;
+	acc[1] = seed + Prime2;
+	acc[2] = seed;
+	acc[3] = seed - Prime1;
+	bufferLen = 0;
+	totalLen = 0;
+};
+
+void Hash64State::Update(const void* data, size_t len) {
+	const uint8_t* p = (const uint8_t*)data;
+	totalLen += len;
+
+	// Top up a partial stripe first.
+	if (bufferLen > 0) {
+		size_t take = std::min(len, (size_t)(32 - bufferLen));
+		memcpy(buffer + bufferLen, p, take);
+		bufferLen += (uint32_t)take;
+		p += take;
+		len -= take;
+		if (bufferLen < 32) { return; }
+
+		for (int t = 0; t < 4; t++) {
+			acc[t] = Round(acc[t], Read64(buffer + t * 8));
+		}
+		bufferLen = 0;
+	}
+
+	uint64_t v1 = acc[0], v2 = acc[1], v3 = acc[2], v4 = acc[3];
+	while (len >= 32) {
+		v1 = Round(v1, Read64(p));
+		v2 = Round(v2, Read64(p + 8));
+		v3 = Round(v3, Read64(p + 16));
+		v4 = Round(v4, Read64(p + 24));
+		p += 32;
+		len -= 32;
+	}
+	acc[0] = v1; acc[1] = v2; acc[2] = v3; acc[3] = v4;
+
+	if (len > 0) {
+		memcpy(buffer, p, len);
+		bufferLen = (uint32_t)len;
+	}
+};
+
+uint64_t Hash64State::Value() const {
+	uint64_t h;
+	if (totalLen >= 32) {
+		h = RotL(acc[0], 1) + RotL(acc[1], 7) + RotL(acc[2], 12) + RotL(acc[3], 18);
+		for (int t = 0; t < 4; t++) {
+			h = MergeRound(h, acc[t]);
+		}
+	}
+	else {
+		h = seed + Prime5;
+	}
+	h += totalLen;
+
+	const uint8_t* p = buffer;
+	uint32_t len = bufferLen;
+	while (len >= 8) {
+		h ^= Round(0, Read64(p));
+		h = RotL(h, 27) * Prime1 + Prime4;
+		p += 8;
+		len -= 8;
+	}
+	if (len >= 4) {
+		h ^= (uint64_t)Read32(p) * Prime1;
+		h = RotL(h, 23) * Prime2 + Prime3;
+		p += 4;
+		len -= 4;
+	}
+	while (len--) {
+		h ^= (*p++) * Prime5;
+		h = RotL(h, 11) * Prime1;
+	}
+
+	h ^= h >> 33;
+	h *= Prime2;
+	h ^= h >> 29;
+	h *= Prime3;
+	h ^= h >> 32;
+	return h;
+};
+
+//---------------------------------------------------------------
+#pragma mark - One shot
+
+uint32_t Checksum::CRC32C(const void* data, size_t len) {
+	CRC32CState crc;
+	crc.Update(data, len);
+	return crc.Value();
+};
+
+uint64_t Checksum::Hash64(const void* data, size_t len, uint64_t seed) {
+	Hash64State hash(seed);
+	hash.Update(data, len);
+	return hash.Value();
+};
+
+//----
+
+uint32_t Checksum::CRC32C(const ABinaryFile& file) {
+	DebugPretty
+
+	return CRC32C(file.Blob(), file.Size());
+};
+
+uint64_t Checksum::Hash64(const ABinaryFile& file, uint64_t seed) {
+	DebugPretty
+
+	return Hash64(file.Blob(), file.Size(), seed);
+};
+
+Digest Checksum::DigestOf(const ABinaryFile& file, uint64_t seed) {
+	DebugPretty
+
+	// Hashed in slices so each slice is still in L2 for the second pass.
+	const size_t slice = 64 * 1024;
+	const uint8_t* p = (const uint8_t*)file.Blob();
+	uint64_t remaining = file.Size();
+
+	CRC32CState crc;
+	Hash64State hash(seed);
+	while (remaining > 0) {
+		size_t len = remaining < slice ? (size_t)remaining : slice;
+		crc.Update(p, len);
+		hash.Update(p, len);
+		p += len;
+		remaining -= len;
+	}
+	return {crc.Value(), hash.Value()};
+};
+
+//----
+
+// Hand each block of a big file to proc. Uses CopyToBlob() so blocks that are not
+// resident are read directly and the cache is left as it was.
+template<class P> static void EachBlock(ABigBinaryFile& file, P proc) {
+	std::vector<uint8_t> buffer(file.BlockSize());
+	for (uint64_t blk = 0; blk < file.BlockCount(); blk++) {
+		uint64_t len = file.CopyToBlob(buffer.data(), file.BlockSize(), blk);
+		proc(buffer.data(), len);
+	}
+};
+
+uint32_t Checksum::CRC32C(ABigBinaryFile& file) {
+	DebugPretty
+
+	CRC32CState crc;
+	EachBlock(file, [&](const uint8_t* p, uint64_t len) { crc.Update(p, len); });
+	return crc.Value();
+};
+
+uint64_t Checksum::Hash64(ABigBinaryFile& file, uint64_t seed) {
+	DebugPretty
+
+	Hash64State hash(seed);
+	EachBlock(file, [&](const uint8_t* p, uint64_t len) { hash.Update(p, len); });
+	return hash.Value();
+};
+
+Digest Checksum::DigestOf(ABigBinaryFile& file, uint64_t seed) {
+	DebugPretty
+
+	CRC32CState crc;
+	Hash64State hash(seed);
+	EachBlock(file, [&](const uint8_t* p, uint64_t len) {
+		crc.Update(p, len);
+		hash.Update(p, len);
+	});
+	return {crc.Value(), hash.Value()};
+};
@@ -0,0 +1,86 @@
+//
+//  Checksum.hpp
+//  CPP-Utilities
+//
+//  Created by agent on 17/10/26.
+//  Copyright © 2026 tridiak. All rights reserved.
+//
+
+#ifndef Checksum_hpp
+#define Checksum_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include "ABinaryFile.hpp"
+
+/*
+ Checksums and hashes over memory, ABinaryFile and ABigBinaryFile.
+
+ CRC32C is the Castagnoli CRC (iSCSI, ext4, etc). It uses the SSE4.2 crc32
+ instruction when the CPU has it (checked at run time) or the ARMv8 CRC
+ instructions when the compiler targets them. Otherwise a slicing-by-8 table.
+
+ Hash64 is XXH64, so values match any other xxHash implementation.
+ It is fast and well distributed but not cryptographic.
+
+ ABigBinaryFile is processed a block at a time. Blocks already in its cache
+ are used as they are. Others are read straight from the file and are not
+ added to the cache, so hashing does not evict anything.
+*/
+
+namespace Checksum {
+
+// Incremental CRC32C. Feed data with Update() in any number of pieces.
+class CRC32CState {
+	uint32_t state;
+public:
+	CRC32CState() { Reset(); }
+
+	void Update(const void* data, size_t len);
+	uint32_t Value() const { return ~state; }
+	void Reset() { state = 0xFFFFFFFF; }
+};
+
+// Incremental XXH64.
+class Hash64State {
+	uint64_t seed;
+	uint64_t acc[4];
+	// Input not yet consumed. Stripes are 32 bytes.
+	uint8_t buffer[32];
+	uint32_t bufferLen;
+	uint64_t totalLen;
+public:
+	Hash64State(uint64_t seed = 0) : seed(seed) { Reset(); }
+
+	void Update(const void* data, size_t len);
+	uint64_t Value() const;
+	void Reset();
+};
+
+// Both in one pass.
+struct Digest {
+	uint32_t crc32c;
+	uint64_t hash64;
+};
+
+//----
+
+// True if CRC32C runs on hardware instructions on this machine.
+bool HardwareCRC32C();
+
+uint32_t CRC32C(const void* data, size_t len);
+uint64_t Hash64(const void* data, size_t len, uint64_t seed = 0);
+
+// Whole file.
+uint32_t CRC32C(const ABinaryFile& file);
+uint64_t Hash64(const ABinaryFile& file, uint64_t seed = 0);
+Digest DigestOf(const ABinaryFile& file, uint64_t seed = 0);
+
+// Whole file, block by block. Can throw the exceptions ABigBinaryFile throws.
+uint32_t CRC32C(ABigBinaryFile& file);
+uint64_t Hash64(ABigBinaryFile& file, uint64_t seed = 0);
+Digest DigestOf(ABigBinaryFile& file, uint64_t seed = 0);
+
+}; // namespace
+
+#endif /* Checksum_hpp */
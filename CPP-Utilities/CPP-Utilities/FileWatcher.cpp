@@ -0,0 +1,163 @@
+//
+//  FileWatcher.cpp
+//  CPP-Utilities
+//
+//  Created by agent on 17/10/26.
+//  Copyright © 2026 tridiak. All rights reserved.
+//
+
+#include "FileWatcher.hpp"
+#include "ABinaryFile.hpp"
+#include "Debug.hpp"
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <algorithm>
+#include <system_error>
+
+#ifdef __linux__
+	#include <sys/inotify.h>
+
+	// Anything that changes what a reader of the file would see.
+	#define WatchMask (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF)
+#endif
+
+AFileWatcher::AFileWatcher() : notifyDesc(-1) {
+	DebugPretty
+
+	stopPipe[0] = stopPipe[1] = -1;
+#ifdef __linux__
+	notifyDesc = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+	if (notifyDesc < 0) { return; }
+	if (pipe(stopPipe) != 0) {
+		close(notifyDesc);
+		notifyDesc = -1;
+		return;
+	}
+
+	try {
+		thread = std::thread(&AFileWatcher::Run, this);
+	}
+	catch (const std::system_error&) {
+		close(notifyDesc);
+		close(stopPipe[0]);
+		close(stopPipe[1]);
+		throw ABinaryFile::ABinaryFileEx("Could not start the file watcher thread");
+	}
+#endif
+};
+
+AFileWatcher::~AFileWatcher() {
+	DebugPretty
+
+	if (notifyDesc < 0) { return; }
+	char c = 0;
+	while (write(stopPipe[1], &c, 1) < 0 && errno == EINTR) {}
+	thread.join();
+	close(notifyDesc);
+	close(stopPipe[0]);
+	close(stopPipe[1]);
+};
+
+static std::mutex globalLock;
+static std::shared_ptr<AFileWatcher> globalWatcher;
+
+std::shared_ptr<AFileWatcher> AFileWatcher::Global() {
+	std::lock_guard<std::mutex> guard(globalLock);
+	if (!globalWatcher) { globalWatcher = std::make_shared<AFileWatcher>(); }
+	return globalWatcher;
+};
+
+//----
+
+std::shared_ptr<AFileWatcher::Watch> AFileWatcher::Add(const std::string& path) {
+	DebugPretty
+
+	if (notifyDesc < 0) { return nullptr; }
+#ifdef __linux__
+	std::lock_guard<std::mutex> guard(lock);
+	// The same file gives the same descriptor.
+	int wd = inotify_add_watch(notifyDesc, path.c_str(), WatchMask);
+	if (wd < 0) { return nullptr; }
+
+	std::shared_ptr<Watch> watch = std::make_shared<Watch>();
+	watch->wd = wd;
+	watches[wd].push_back(watch.get());
+	return watch;
+#else
+	return nullptr;
+#endif
+};
+
+std::shared_ptr<AFileWatcher::Watch> AFileWatcher::Add(int desc) {
+	// inotify follows the link to the open file.
+	return Add("/proc/self/fd/" + std::to_string(desc));
+};
+
+void AFileWatcher::Remove(const std::shared_ptr<Watch>& watch) {
+	if (!watch) { return; }
+	std::lock_guard<std::mutex> guard(lock);
+	auto itr = watches.find(watch->wd);
+	if (itr == watches.end()) { return; }
+
+	std::vector<Watch*>& list = itr->second;
+	list.erase(std::remove(list.begin(), list.end(), watch.get()), list.end());
+	if (list.empty()) {
+#ifdef __linux__
+		inotify_rm_watch(notifyDesc, itr->first);
+#endif
+		watches.erase(itr);
+	}
+};
+
+uint64_t AFileWatcher::Count() {
+	std::lock_guard<std::mutex> guard(lock);
+	return watches.size();
+};
+
+//----
+
+void AFileWatcher::Run() {
+#ifdef __linux__
+	alignas(struct inotify_event) char buffer[4096];
+	for (;;) {
+		struct pollfd fds[2] = { { notifyDesc, POLLIN, 0 }, { stopPipe[0], POLLIN, 0 } };
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR) { continue; }
+			return;
+		}
+		if (fds[1].revents) { return; }
+
+		ssize_t len = read(notifyDesc, buffer, sizeof(buffer));
+		if (len <= 0) { continue; }
+
+		std::lock_guard<std::mutex> guard(lock);
+		for (char* p = buffer; p < buffer + len; ) {
+			const struct inotify_event* E = (const struct inotify_event*)p;
+			p += sizeof(struct inotify_event) + E->len;
+
+			if (E->mask & IN_Q_OVERFLOW) {
+				// Events were lost, so any file could have changed unseen. The watches
+				// themselves are still in place.
+				for (auto& I : watches) {
+					for (Watch* W : I.second) {
+						W->dirty.store(true, std::memory_order_release);
+					}
+				}
+				continue;
+			}
+
+			auto itr = watches.find(E->wd);
+			if (itr == watches.end()) { continue; }
+			bool lost = (E->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) != 0;
+			for (Watch* W : itr->second) {
+				if (lost) { W->gone.store(true, std::memory_order_relaxed); }
+				W->dirty.store(true, std::memory_order_release);
+			}
+			// The kernel has dropped the watch.
+			if (E->mask & IN_IGNORED) { watches.erase(itr); }
+		}
+	}
+#endif
+};
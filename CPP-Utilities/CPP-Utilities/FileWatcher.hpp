@@ -0,0 +1,87 @@
+//
+//  FileWatcher.hpp
+//  CPP-Utilities
+//
+//  Created by agent on 17/10/26.
+//  Copyright © 2026 tridiak. All rights reserved.
+//
+
+#ifndef FileWatcher_hpp
+#define FileWatcher_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+
+/*
+ Flags files that have changed, so a user can test one atomic flag instead of calling
+ stat(). Used by ABigBinaryFile::SetWatched().
+
+ On Linux one thread reads inotify events for every file watched and sets the flags
+ of the watches on the changed file. Writes, truncation, attribute changes, and the
+ file being deleted or renamed all set dirty. Deleting or renaming also sets gone,
+ after which the file is no longer watched. If the kernel drops events every watch
+ is set dirty.
+ Elsewhere Available() is false and Add() always returns nullptr.
+
+ Flags are set some time after the change, when the thread gets the event.
+ Which bytes changed is not known.
+
+ Thread safe.
+*/
+
+class AFileWatcher {
+public:
+	struct Watch {
+		// Set on a change. The user clears it, with exchange(false), before looking.
+		std::atomic<bool> dirty;
+		// No longer watched, as the file was deleted or renamed. Never cleared.
+		std::atomic<bool> gone;
+		// inotify watch descriptor.
+		int wd;
+
+		Watch() : dirty(false), gone(false), wd(-1) {}
+	};
+private:
+	int notifyDesc;
+	// Written to stop the thread.
+	int stopPipe[2];
+
+	std::mutex lock;
+	// Watches for each watch descriptor. Several for one file share its descriptor.
+	std::unordered_map<int, std::vector<Watch*>> watches;
+	std::thread thread;
+
+	void Run();
+public:
+	// Throws ABinaryFile::ABinaryFileEx if inotify is there but the thread can not be
+	// started.
+	AFileWatcher();
+	AFileWatcher(const AFileWatcher&) = delete;
+	AFileWatcher& operator=(const AFileWatcher&) = delete;
+	~AFileWatcher();
+
+	// The process wide watcher, made on first use.
+	static std::shared_ptr<AFileWatcher> Global();
+
+	bool Available() const { return notifyDesc >= 0; }
+
+	// Watch the file at path, following symbolic links. nullptr if it can not be watched.
+	// Must be given to Remove() before it goes.
+	std::shared_ptr<Watch> Add(const std::string& path);
+	// Watch the file open as desc. nullptr if it can not be watched.
+	std::shared_ptr<Watch> Add(int desc);
+
+	void Remove(const std::shared_ptr<Watch>& watch);
+
+	// Files watched.
+	uint64_t Count();
+};
+
+#endif /* FileWatcher_hpp */
@@ -0,0 +1,154 @@
+//
+//  RecordView.hpp
+//  CPP-Utilities
+//
+//  Created by agent on 17/10/26.
+//  Copyright © 2026 tridiak. All rights reserved.
+//
+
+#ifndef RecordView_hpp
+#define RecordView_hpp
+
+#include <stdio.h>
+#include <string.h>
+#include <iterator>
+#include <type_traits>
+#include "ABinaryFile.hpp"
+
+/*
+ Typed view of fixed stride records in an ABinaryFile.
+
+ Record i is the sizeof(T) bytes at offset + i * stride. Records are read with
+ memcpy(), so neither offset nor stride has to suit T's alignment. Nothing is
+ copied out of the file up front. The view holds a copy of the ABinaryFile,
+ which shares its data (an O(1) copy), so the data lives as long as the view.
+
+ The view is read only and has no mutable state, so any number of threads can
+ read it at once. Use Slice() to split the records between threads.
+
+ T must be trivially copyable. Its layout must match the file, including padding.
+ Use Field() for records with a layout that can not be expressed as a struct.
+*/
+
+template<class T> class RecordView {
+	static_assert(std::is_trivially_copyable<T>::value, "RecordView needs a trivially copyable type");
+
+	ABinaryFile file;
+	const uint8_t* base;
+	uint64_t stride;
+	uint64_t count;
+
+	static uint64_t Fit(uint64_t size, uint64_t offset, uint64_t stride) {
+		if (offset > size || size - offset < sizeof(T)) { return 0; }
+		return (size - offset - sizeof(T)) / stride + 1;
+	};
+public:
+	// Random access iterator. Dereferencing returns the record by value.
+	class Iterator {
+		const RecordView* view;
+		uint64_t idx;
+	public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef int64_t difference_type;
+		typedef const T* pointer;
+		typedef T reference;
+
+		Iterator() : view(nullptr), idx(0) {}
+		Iterator(const RecordView* view, uint64_t idx) : view(view), idx(idx) {}
+
+		T operator*() const { return (*view)[idx]; }
+		T operator[](difference_type n) const { return (*view)[idx + n]; }
+		// Record index.
+		uint64_t Index() const { return idx; }
+
+		Iterator& operator++() { idx++; return *this; }
+		Iterator operator++(int) { Iterator t = *this; idx++; return t; }
+		Iterator& operator--() { idx--; return *this; }
+		Iterator operator--(int) { Iterator t = *this; idx--; return t; }
+		Iterator& operator+=(difference_type n) { idx += n; return *this; }
+		Iterator& operator-=(difference_type n) { idx -= n; return *this; }
+		Iterator operator+(difference_type n) const { return Iterator(view, idx + n); }
+		Iterator operator-(difference_type n) const { return Iterator(view, idx - n); }
+		friend Iterator operator+(difference_type n, const Iterator& I) { return I + n; }
+		difference_type operator-(const Iterator& I) const { return (difference_type)(idx - I.idx); }
+
+		bool operator==(const Iterator& I) const { return idx == I.idx; }
+		bool operator!=(const Iterator& I) const { return idx != I.idx; }
+		bool operator<(const Iterator& I) const { return idx < I.idx; }
+		bool operator>(const Iterator& I) const { return idx > I.idx; }
+		bool operator<=(const Iterator& I) const { return idx <= I.idx; }
+		bool operator>=(const Iterator& I) const { return idx >= I.idx; }
+	};
+
+	// Can throw ABinaryFileEx
+	// stride == 0 means sizeof(T). count == 0 means as many records as fit.
+	// Throws if stride < sizeof(T) or count records do not fit.
+	RecordView(const ABinaryFile& file, uint64_t offset = 0, uint64_t stride = 0, uint64_t count = 0)
+			: file(file), stride(stride ? stride : sizeof(T)) {
+		if (this->stride < sizeof(T)) { throw ABinaryFile::ABinaryFileEx("RecordView stride is less than the record size"); }
+
+		uint64_t fit = Fit(file.Size(), offset, this->stride);
+		if (count > fit) { throw ABinaryFile::ABinaryFileEx("RecordView records exceed data size"); }
+		this->count = count ? count : fit;
+		base = (const uint8_t*)file.Blob() + (fit ? offset : 0);
+	};
+
+	//----
+
+	uint64_t Size() const { return count; }
+	bool Empty() const { return count == 0; }
+	uint64_t Stride() const { return stride; }
+
+	// No bounds check.
+	T operator[](uint64_t idx) const {
+		T v;
+		memcpy(&v, base + idx * stride, sizeof(T));
+		return v;
+	};
+
+	// Can throw ABinaryFileEx
+	T At(uint64_t idx) const {
+		if (idx >= count) { throw ABinaryFile::ABinaryFileEx("Out of range"); }
+		return (*this)[idx];
+	};
+
+	// A single field of record idx, of type U at byte offset off within the record.
+	// No bounds check. Use offsetof() for fields of T.
+	template<class U> U Field(uint64_t idx, uint64_t off) const {
+		static_assert(std::is_trivially_copyable<U>::value, "Field() needs a trivially copyable type");
+		U v;
+		memcpy(&v, base + idx * stride + off, sizeof(U));
+		return v;
+	};
+
+	// As Field() but converted from the given byte order. U must be arithmetic.
+	template<class U> U Field(uint64_t idx, uint64_t off, ByteOrder::Endian order) const {
+		return ByteOrder::Load<U>(base + idx * stride + off, order);
+	};
+
+	// Raw bytes of record idx, sizeof(T) of them. Padding up to stride is not included,
+	// as the last record need not have any. No bounds check.
+	ByteSpan Bytes(uint64_t idx) const { return ByteSpan(base + idx * stride, sizeof(T)); }
+
+	// Records as a plain array, if stride == sizeof(T) and the first record is
+	// suitably aligned for T. nullptr otherwise.
+	const T* Data() const {
+		if (stride != sizeof(T) || ((uintptr_t)base % alignof(T)) != 0) { return nullptr; }
+		return (const T*)base;
+	};
+
+	// count records from first. Shares the data. Can throw ABinaryFileEx
+	RecordView Slice(uint64_t first, uint64_t count) const {
+		if (first > this->count || count > this->count - first) { throw ABinaryFile::ABinaryFileEx("Out of range"); }
+		RecordView v = *this;
+		v.base = base + first * stride;
+		v.count = count;
+		return v;
+	};
+
+	Iterator begin() const { return Iterator(this, 0); }
+	Iterator end() const { return Iterator(this, count); }
+};
+
+#endif /* RecordView_hpp */
@@ -20,6 +20,10 @@
 	// Insert code here to initialize your application
 	HeirarchyUsage();
 //	TextFileUsage();
+//	ChecksumUsage();
+//	ByteSearchUsage();
+//	BlockCacheUsage();
+//	BigFileWriteUsage();
 	
 	exit(0);
 }
@@ -17,7 +17,13 @@
 #include "TreeHier.hpp"
 #include "DirContents.hpp"
 #include "FileUtil.hpp"
+#include "Checksum.hpp"
+#include "ByteSearch.hpp"
+#include "BlockCache.hpp"
 #include <iostream>
+#include <algorithm>
+#include <string.h>
+#include <unistd.h>
 
 #pragma mark String Stuff
 
@@ -438,5 +444,145 @@ void HeirarchyUsage() {
 		printf("Exception: %s\n", ex.what());
 	};
 };
+//-----------------------------------------
+#pragma mark Checks
+
+// ABigBinaryFile has a Write() of its own.
+#undef Write
+
+static void Check(const char* what, bool ok) {
+	printf("%s : %s\n", what, ok ? "ok" : "FAILED");
+};
+
+void ChecksumUsage() {
+	// Known answers, from the CRC32C and xxHash reference implementations.
+	Check("CRC32C(\"123456789\")", Checksum::CRC32C("123456789", 9) == 0xE3069283);
+	Check("Hash64(\"\")", Checksum::Hash64("", 0) == 0xEF46DB3751D8E999ULL);
+	Check("Hash64(\"abc\")", Checksum::Hash64("abc", 3) == 0x44BC2CF5AD770999ULL);
+	Check("Hash64(\"123456789\")", Checksum::Hash64("123456789", 9) == 0x8CB841DB40E6AE83ULL);
+	
+	const char* fox = "The quick brown fox jumps over the lazy dog";
+	Check("Hash64(fox)", Checksum::Hash64(fox, strlen(fox)) == 0x0B242D361FDA71BCULL);
+	Check("Hash64(fox, seed 1)", Checksum::Hash64(fox, strlen(fox), 1) == 0xDF5091B6DAD2C6DBULL);
+	
+	// 1KB, so every stripe path is used. Fed in uneven pieces as well.
+	uint8_t data[1024];
+	for (int t=0; t < 1024; t++) { data[t] = (uint8_t)t; }
+	Check("Hash64(1KB)", Checksum::Hash64(data, sizeof(data)) == 0x6F3914F18FE4DF57ULL);
+	Checksum::Hash64State H;
+	Checksum::CRC32CState C;
+	for (size_t pos=0, len=1; pos < sizeof(data); pos += len, len = len * 2 + 1) {
+		len = std::min(len, sizeof(data) - pos);
+		H.Update(data + pos, len);
+		C.Update(data + pos, len);
+	}
+	Check("Hash64State in pieces", H.Value() == Checksum::Hash64(data, sizeof(data)));
+	Check("CRC32CState in pieces", C.Value() == Checksum::CRC32C(data, sizeof(data)));
+	printf("CRC32C on hardware : %s\n", Checksum::HardwareCRC32C() ? "yes" : "no");
+};
 
+void ByteSearchUsage() {
+	// Against a byte at a time search, over lengths and alignments either side of the
+	// vector widths.
+	std::vector<uint8_t> data(4096);
+	for (size_t t=0; t < data.size(); t++) { data[t] = (uint8_t)arc4random_uniform(4); }
+	
+	bool findOK = true;
+	bool countOK = true;
+	bool lfOK = true;
+	for (uint64_t patLen=1; patLen < 40; patLen += 3) {
+		for (uint64_t start=0; start < 70; start += 7) {
+			const uint8_t* pat = &data[1000 + start * 13];
+			const uint8_t* from = &data[start];
+			uint64_t len = data.size() - start;
+			
+			int64_t want = -1;
+			uint64_t count = 0;
+			for (uint64_t t=0; t + patLen <= len; t++) {
+				if (memcmp(from + t, pat, patLen) != 0) { continue; }
+				if (want < 0) { want = (int64_t)t; }
+				count++;
+			}
+			if (ByteSearch::Find(from, len, pat, patLen) != want) { findOK = false; }
+			if (ByteSearch::Count(from, len, pat, patLen) != count) { countOK = false; }
+		}
+	}
+	for (uint64_t len=0; len < 200; len++) {
+		std::vector<uint64_t> want;
+		for (uint64_t t=0; t < len; t++) {
+			if (data[t] == 3) { want.push_back(t + 10); }
+		}
+		std::vector<uint64_t> found;
+		ByteSearch::FindAllByte(data.data(), len, 3, found, 10);
+		if (found != want) { lfOK = false; }
+	}
+	Check("ByteSearch::Find", findOK);
+	Check("ByteSearch::Count", countOK);
+	Check("ByteSearch::FindAllByte", lfOK);
+};
 
+void BlockCacheUsage() {
+	int64_t evicted;
+	
+	// lru evicts the block used longest ago.
+	ABlockCache lru(256, 3, ABlockCache::Policy::lru);
+	for (uint64_t b=1; b <= 3; b++) { lru.Filled(lru.Insert(b, evicted)); }
+	lru.Find(1);
+	lru.Filled(lru.Insert(4, evicted));
+	Check("lru evicts least recently used", evicted == 2);
+	
+	// A pinned block is never evicted. Peek() so it stays the oldest.
+	lru.Pin(lru.Peek(3));
+	lru.Filled(lru.Insert(5, evicted));
+	Check("lru skips pinned", evicted == 1);
+	lru.Filled(lru.Insert(6, evicted));
+	Check("lru skips pinned again", evicted == 4);
+	
+	// twoQ: a scan passes through probation, leaving the main list alone.
+	ABlockCache twoQ(256, 8, ABlockCache::Policy::twoQ);
+	for (uint64_t b=0; b < 12; b++) { twoQ.Filled(twoQ.Insert(b, evicted)); }
+	// Evicted from probation, so promoted when loaded again.
+	twoQ.Filled(twoQ.Insert(0, evicted));
+	for (uint64_t b=100; b < 200; b++) { twoQ.Filled(twoQ.Insert(b, evicted)); }
+	Check("twoQ keeps a reused block through a scan", twoQ.Contains(0));
+};
+
+void BigFileWriteUsage() {
+	try {
+		char path[] = "/tmp/CPP_Test.XXXXXX";
+		int desc = mkstemp(path);
+		if (desc < 0) { throw ABinaryFile::ABinaryFileEx("Could not make a temporary file"); }
+		std::vector<uint8_t> data(100000);
+		for (size_t t=0; t < data.size(); t++) { data[t] = (uint8_t)(t * 7); }
+		bool made = write(desc, data.data(), data.size()) == (ssize_t)data.size();
+		close(desc);
+		if (!made) { throw ABinaryFile::ABinaryFileEx("Could not write the temporary file"); }
+		
+		{
+			ABigBinaryFile big(path, 4096, 8);
+			Check("SetWritable", big.SetWritable(true));
+			// Spans blocks, and more blocks than the cache holds.
+			for (uint64_t pos=100; pos < 90000; pos += 3001) {
+				big.Write(pos, "ABCDEFGHIJ", 10);
+				memcpy(&data[pos], "ABCDEFGHIJ", 10);
+			}
+			big.Write(data.size() - 3, "XYZ", 3);
+			memcpy(&data[data.size() - 3], "XYZ", 3);
+			big.Flush(true);
+			Check("Flush leaves nothing dirty", big.DirtyBlocks() == 0);
+			big.FileCheck();
+			Check("Own writes are not a change", big.LastChange() == ABigBinaryFile::FileChange::none);
+		}
+		
+		ABigBinaryFile reopened(path, 4096, 8);
+		bool same = reopened.Size() == data.size();
+		for (uint64_t pos=0; same && pos < data.size(); pos++) {
+			same = reopened[pos] == data[pos];
+		}
+		Check("Write, Flush, reopen", same);
+		unlink(path);
+	}
+	catch (ABinaryFile::ABinaryFileEx& ex) {
+		printf("Exception : %s\n", ex.what());
+	};
+};
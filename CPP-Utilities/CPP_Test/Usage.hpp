@@ -23,6 +23,10 @@ void BinaryFileUsage(void);
 void TextFileUsage(void);
 void PosNegUsage(void);
 void HeirarchyUsage(void);
+void ChecksumUsage(void);
+void ByteSearchUsage(void);
+void BlockCacheUsage(void);
+void BigFileWriteUsage(void);
 
 #ifdef __cplusplus
 }